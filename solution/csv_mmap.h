@@ -0,0 +1,287 @@
+/**
+ * @file csv_mmap.h
+ * @brief Zero-copy CSV loader for the decade song files.
+ * Each file is memory-mapped and parsed in place: fields are located with the SIMD structural
+ * index of csv_tokenizer.h, text fields are string_views into the mapping and numeric fields
+ * are converted with std::from_chars, so no per-row stringstream or temporary strings are
+ * created. Requires a POSIX system (mmap) and C++17.
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef PLAYLIST_CSV_MMAP_H
+#define PLAYLIST_CSV_MMAP_H
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "song.h"
+#include "song_schema.h"
+#include "csv_tokenizer.h"
+
+/**
+ * @brief Read-only memory mapping of a whole file, unmapped on destruction.
+ *
+ */
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+    ~MappedFile() { close(); }
+
+    bool open(const std::string &path)
+    {
+    /**
+     * @brief Maps the file at path into memory
+     *
+     * @param path - file to map
+     * @return true if the file was opened and mapped (an empty file maps to an empty view)
+     */
+        close();
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0)
+        {
+            ::close(fd);
+            return false;
+        }
+        size_ = static_cast<size_t>(st.st_size);
+        if (size_ > 0)
+        {
+            void *addr = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (addr == MAP_FAILED)
+            {
+                ::close(fd);
+                size_ = 0;
+                return false;
+            }
+            data_ = static_cast<const char *>(addr);
+            // We parse front to back exactly once
+            madvise(addr, size_, MADV_SEQUENTIAL);
+        }
+        // The mapping stays valid after the descriptor is closed
+        ::close(fd);
+        return true;
+    }
+
+    void close()
+    {
+        if (data_ != nullptr)
+        {
+            munmap(const_cast<char *>(data_), size_);
+        }
+        data_ = nullptr;
+        size_ = 0;
+    }
+
+    std::string_view view() const { return std::string_view(data_, size_); }
+    size_t size() const { return size_; }
+
+private:
+    const char *data_ = nullptr;
+    size_t size_ = 0;
+};
+
+/**
+ * @brief Timing and row counts reported by a loader run
+ *
+ */
+struct LoadStats
+{
+    size_t rows = 0;        // rows added to songData
+    size_t skipped = 0;     // malformed rows that were ignored
+    size_t bytes = 0;       // bytes of CSV text scanned
+    double seconds = 0;     // wall time spent loading
+
+    double rowsPerSec() const { return seconds > 0 ? rows / seconds : 0; }
+};
+
+inline bool parseCsvInt(std::string_view field, int &out)
+{
+/**
+ * @brief Parses a whole CSV field as an int, without allocating
+ *
+ * @param field - text of the field (a trailing '\r' must already be stripped)
+ * @param out - receives the value on success
+ * @return true if the entire field was a valid integer
+ */
+    const char *first = field.data();
+    const char *last = first + field.size();
+    auto result = std::from_chars(first, last, out);
+    return result.ec == std::errc() && result.ptr == last;
+}
+
+inline bool parseSongFields(const std::string_view *fields, const CsvColumnMap &columns, SongRowView &row,
+                            std::string *scratch)
+{
+/**
+ * @brief Fills a SongRowView from the fields of one row. Quoted text fields are unquoted;
+ * the views point into the row itself or, for fields with "" escapes, into scratch.
+ *
+ * @param fields - the row's fields, columns.columns of them, without the line terminator
+ * @param columns - where each column is
+ * @param row - receives the parsed fields
+ * @param scratch - three buffers for unescaped title, artist and genre, reused between rows
+ * @return true if every numeric column parsed
+ */
+    row.title = unquoteCsvField(fields[columns.title], scratch[0]);
+    row.artist = unquoteCsvField(fields[columns.artist], scratch[1]);
+    row.genre = unquoteCsvField(fields[columns.genre], scratch[2]);
+    bool ok = true;
+    forEachFeature([&](auto k) {
+        ok = parseCsvInt(fields[columns.feature[k]], feature<k>(row)) && ok;
+    });
+    return ok;
+}
+
+inline Song toSong(const SongRowView &row)
+{
+/**
+ * @brief Copies a parsed row out of the mapping into an owning Song (dj_score = 0)
+ *
+ * @param row - parsed CSV row
+ */
+    Song song;
+    song.title.assign(row.title);
+    song.artist.assign(row.artist);
+    song.genre.assign(row.genre);
+    copyFeatures(row, song);
+    song.dj_score = 0;
+    return song;
+}
+
+template <typename RowFn>
+size_t forEachSongRow(std::string_view text, RowFn &&onRow, size_t *skipped = nullptr, bool skipHeader = true,
+                      CsvColumnMap *columns = nullptr)
+{
+/**
+ * @brief Calls onRow(const SongRowView &) for every data row of a song CSV held in memory.
+ * The UTF-8 BOM is skipped and columns are found by the names in the header line, and both
+ * "\n" and "\r\n" line endings are accepted. Quoted fields may contain commas and newlines
+ * (RFC 4180). Blank and malformed rows are ignored.
+ *
+ * @param text - entire CSV file contents, or a run of whole rows from one
+ * @param onRow - callback invoked once per valid row
+ * @param skipped - optional counter of malformed rows
+ * @param skipHeader - false when text starts past the header (a later chunk of the file)
+ * @param columns - optional column map: filled from the header when skipHeader is set,
+ *                  otherwise used as is (the default layout when null)
+ * @return number of rows passed to onRow
+ */
+    static const char BOM[] = "\xEF\xBB\xBF";
+    if (text.substr(0, 3) == std::string_view(BOM, 3))
+    {
+        text.remove_prefix(3);
+    }
+
+    CsvColumnMap defaultColumns;
+    CsvColumnMap &map = columns != nullptr ? *columns : defaultColumns;
+    size_t rows = 0;
+    bool header = skipHeader;
+    std::string_view fields[CsvColumnMap::MAX_COLUMNS];
+    std::string scratch[3];
+    size_t count = 0;       // separators seen in the current row
+    size_t rowStart = 0;
+    size_t fieldStart = 0;
+    auto endRow = [&](size_t end) {
+        if (end > rowStart && text[end - 1] == '\r')
+        {
+            --end;
+        }
+        if (count < CsvColumnMap::MAX_COLUMNS)
+        {
+            fields[count] = text.substr(fieldStart, end - fieldStart);
+        }
+        if (header)
+        {
+            header = false;
+            map.resolve(fields, static_cast<int>(std::min<size_t>(count + 1, CsvColumnMap::MAX_COLUMNS + 1)));
+        }
+        else if (end > rowStart)
+        {
+            SongRowView row;
+            // a row with more or fewer fields than the header is malformed
+            if (count + 1 == static_cast<size_t>(map.columns) && parseSongFields(fields, map, row, scratch))
+            {
+                onRow(row);
+                ++rows;
+            }
+            else if (skipped != nullptr)
+            {
+                ++*skipped;
+            }
+        }
+    };
+
+    CsvStructuralIndex index;
+    index.forEachStructural(text, [&](size_t pos, bool newline) {
+        if (newline)
+        {
+            endRow(pos);
+            count = 0;
+            rowStart = fieldStart = pos + 1;
+            return;
+        }
+        if (count < CsvColumnMap::MAX_COLUMNS)
+        {
+            fields[count] = text.substr(fieldStart, pos - fieldStart);
+        }
+        ++count;
+        fieldStart = pos + 1;
+    });
+    if (rowStart < text.size())
+    {
+        endRow(text.size());
+    }
+    return rows;
+}
+
+inline bool readMappedFile(const std::string &path, std::vector<Song> &songData, LoadStats &stats)
+{
+/**
+ * @brief Memory-maps a song CSV and appends its rows to songData. Drop-in replacement for
+ * readFile; the only allocations are the Song strings themselves.
+ *
+ * @param path - CSV file to load
+ * @param songData - vector of all song data
+ * @param stats - accumulates rows, bytes and time for this call
+ * @return false if the file could not be opened or mapped
+ */
+    auto start = std::chrono::steady_clock::now();
+
+    MappedFile file;
+    if (!file.open(path))
+    {
+        return false;
+    }
+
+    size_t rows = forEachSongRow(file.view(), [&songData](const SongRowView &row) {
+        songData.push_back(toSong(row));
+    }, &stats.skipped);
+
+    stats.rows += rows;
+    stats.bytes += file.size();
+    stats.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return true;
+}
+
+#endif // PLAYLIST_CSV_MMAP_H
@@ -0,0 +1,400 @@
+/**
+ * @file csv_tokenizer.h
+ * @brief Structural index of CSV text, built 64 bytes at a time in the style of simdjson.
+ * Stage 1 classifies each 64-byte block with SIMD compares into three bitmasks: quotes,
+ * commas and newlines. A prefix XOR of the quote mask marks the bytes inside quoted fields
+ * (an escaped "" flips the state twice, so it needs no special case), and masking those out
+ * leaves only the commas and newlines that really separate fields and rows. Stage 2 walks the
+ * set bits of those masks, so field extraction never looks at the bytes in between.
+ *
+ * Quoting follows RFC 4180: a field that starts with a quote may hold commas, newlines and
+ * "" escapes. Quotes anywhere else are not allowed by the RFC and are not supported: they
+ * toggle the quoted state just the same. The index only locates fields, so they come out raw,
+ * quotes included; loaders turn text fields into their values with unquoteCsvField before
+ * storing them, so titles, artists and genres are held, looked up and printed unquoted.
+ *
+ * On x86 the AVX2 (2 x 32 bytes) or SSE2 (4 x 16 bytes) classifier is picked at runtime with
+ * a scalar fallback everywhere else.
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef PLAYLIST_CSV_TOKENIZER_H
+#define PLAYLIST_CSV_TOKENIZER_H
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define PLAYLIST_CSV_X86 1
+#include <immintrin.h>
+#endif
+
+/**
+ * @brief Code paths the stage 1 classifier can run
+ *
+ */
+enum class CsvScanPath
+{
+    Scalar,
+    SSE2,
+    AVX2
+};
+
+inline const char *csvScanPathName(CsvScanPath path)
+{
+    switch (path)
+    {
+    case CsvScanPath::AVX2:
+        return "avx2";
+    case CsvScanPath::SSE2:
+        return "sse2";
+    default:
+        return "scalar";
+    }
+}
+
+inline bool csvScanPathSupported(CsvScanPath path)
+{
+/**
+ * @brief Checks whether this CPU can run the given path
+ *
+ * @param path - code path to check
+ */
+#ifdef PLAYLIST_CSV_X86
+    switch (path)
+    {
+    case CsvScanPath::AVX2:
+        return __builtin_cpu_supports("avx2");
+    case CsvScanPath::SSE2:
+        return __builtin_cpu_supports("sse2");
+    default:
+        return true;
+    }
+#else
+    return path == CsvScanPath::Scalar;
+#endif
+}
+
+inline CsvScanPath bestCsvScanPath()
+{
+    static const CsvScanPath best = csvScanPathSupported(CsvScanPath::AVX2) ? CsvScanPath::AVX2
+                                  : csvScanPathSupported(CsvScanPath::SSE2) ? CsvScanPath::SSE2
+                                  : CsvScanPath::Scalar;
+    return best;
+}
+
+/**
+ * @brief Raw character masks of one 64-byte block: bit i is byte i
+ *
+ */
+struct CsvBlockMasks
+{
+    uint64_t quote;
+    uint64_t comma;
+    uint64_t newline;
+};
+
+inline CsvBlockMasks classifyCsvBlockScalar(const char *p)
+{
+    CsvBlockMasks masks{0, 0, 0};
+    for (int i = 0; i < 64; ++i)
+    {
+        const uint64_t bit = uint64_t(1) << i;
+        masks.quote |= p[i] == '"' ? bit : 0;
+        masks.comma |= p[i] == ',' ? bit : 0;
+        masks.newline |= p[i] == '\n' ? bit : 0;
+    }
+    return masks;
+}
+
+#ifdef PLAYLIST_CSV_X86
+__attribute__((target("sse2"))) inline CsvBlockMasks classifyCsvBlockSSE2(const char *p)
+{
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i comma = _mm_set1_epi8(',');
+    const __m128i newline = _mm_set1_epi8('\n');
+    CsvBlockMasks masks{0, 0, 0};
+    for (int part = 0; part < 4; ++part)
+    {
+        const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 16 * part));
+        const int shift = 16 * part;
+        masks.quote |= uint64_t(uint16_t(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, quote)))) << shift;
+        masks.comma |= uint64_t(uint16_t(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, comma)))) << shift;
+        masks.newline |= uint64_t(uint16_t(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, newline)))) << shift;
+    }
+    return masks;
+}
+
+__attribute__((target("avx2"))) inline uint64_t avx2ByteMask(__m256i lo, __m256i hi, char c)
+{
+    const __m256i match = _mm256_set1_epi8(c);
+    return uint64_t(uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, match))))
+         | uint64_t(uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, match)))) << 32;
+}
+
+__attribute__((target("avx2"))) inline CsvBlockMasks classifyCsvBlockAVX2(const char *p)
+{
+    const __m256i lo = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+    const __m256i hi = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + 32));
+    return CsvBlockMasks{avx2ByteMask(lo, hi, '"'), avx2ByteMask(lo, hi, ','), avx2ByteMask(lo, hi, '\n')};
+}
+
+// Whole windows per call, so the block classifier inlines into a loop compiled for its target
+__attribute__((target("sse2"))) inline void classifyCsvWindowSSE2(const char *p, size_t blocks, CsvBlockMasks *out)
+{
+    for (size_t b = 0; b < blocks; ++b)
+    {
+        out[b] = classifyCsvBlockSSE2(p + 64 * b);
+    }
+}
+
+__attribute__((target("avx2"))) inline void classifyCsvWindowAVX2(const char *p, size_t blocks, CsvBlockMasks *out)
+{
+    for (size_t b = 0; b < blocks; ++b)
+    {
+        out[b] = classifyCsvBlockAVX2(p + 64 * b);
+    }
+}
+#endif
+
+inline uint64_t prefixXor(uint64_t bits)
+{
+/**
+ * @brief Bit i of the result is the XOR of bits 0..i: set from each odd quote up to (not
+ * including) the next one
+ */
+    bits ^= bits << 1;
+    bits ^= bits << 2;
+    bits ^= bits << 4;
+    bits ^= bits << 8;
+    bits ^= bits << 16;
+    bits ^= bits << 32;
+    return bits;
+}
+
+inline std::string_view unquoteCsvField(std::string_view field, std::string &scratch)
+{
+/**
+ * @brief The value of a raw CSV field: a quoted field loses its quotes and "" becomes ".
+ * Unquoted fields, and quoted ones without escapes, are returned without copying.
+ *
+ * @param field - raw field, without the line terminator
+ * @param scratch - holds the unescaped text when a copy is needed
+ */
+    if (field.size() < 2 || field.front() != '"' || field.back() != '"')
+    {
+        return field;
+    }
+    field = field.substr(1, field.size() - 2);
+    if (field.find('"') == std::string_view::npos)
+    {
+        return field;
+    }
+    scratch.clear();
+    for (size_t i = 0; i < field.size(); ++i)
+    {
+        scratch.push_back(field[i]);
+        if (field[i] == '"' && i + 1 < field.size() && field[i + 1] == '"')
+        {
+            ++i;
+        }
+    }
+    return scratch;
+}
+
+inline void appendCsvField(std::string &out, std::string_view text)
+{
+/**
+ * @brief Appends text as one CSV field, quoted (with " doubled) only when it holds a comma,
+ * quote or line break; the inverse of unquoteCsvField
+ *
+ * @param out - buffer to append to
+ * @param text - field value
+ */
+    if (text.find_first_of(",\"\r\n") == std::string_view::npos)
+    {
+        out += text;
+        return;
+    }
+    out += '"';
+    for (char c : text)
+    {
+        if (c == '"')
+        {
+            out += '"';
+        }
+        out += c;
+    }
+    out += '"';
+}
+
+/**
+ * @brief Finds the commas and newlines of CSV text that lie outside quoted fields. The text
+ * must start outside a quoted field (at the start of a file or of a row).
+ *
+ */
+class CsvStructuralIndex
+{
+public:
+    explicit CsvStructuralIndex(CsvScanPath path = bestCsvScanPath())
+        : path_(csvScanPathSupported(path) ? path : CsvScanPath::Scalar) {}
+
+    CsvScanPath path() const { return path_; }
+
+    template <typename BlockFn>
+    void scanBlocks(std::string_view text, BlockFn &&onBlock)
+    {
+    /**
+     * @brief Stage 1: calls onBlock(offset, commas, newlines) for each 64-byte block in order,
+     * with the masks of the structural characters in text[offset, offset + 64). Stops early
+     * when onBlock returns false.
+     *
+     * @param text - CSV text
+     * @param onBlock - per-block callback
+     */
+        uint64_t inside = 0;    // all ones while the previous block ended inside quotes
+        size_t offset = 0;
+        while (offset < text.size())
+        {
+            // classify a window of blocks in one tight loop, then resolve the quotes
+            const size_t remaining = text.size() - offset;
+            const size_t blocks = std::min(WINDOW_BLOCKS, (remaining + 63) / 64);
+            const size_t full = std::min(blocks, remaining / 64);
+            classify(text.data() + offset, full);
+            if (full < blocks)
+            {
+                // copy the ragged tail into a padded block; the padding matches nothing
+                char tail[64] = {};
+                std::memcpy(tail, text.data() + offset + full * 64, remaining - full * 64);
+                masks_[full] = classifyOne(tail);
+            }
+            for (size_t b = 0; b < blocks; ++b, offset += 64)
+            {
+                const uint64_t quoted = prefixXor(masks_[b].quote) ^ inside;
+                inside = static_cast<uint64_t>(static_cast<int64_t>(quoted) >> 63);
+                if (!onBlock(offset, masks_[b].comma & ~quoted, masks_[b].newline & ~quoted))
+                {
+                    return;
+                }
+            }
+        }
+    }
+
+    template <typename Fn>
+    void forEachStructural(std::string_view text, Fn &&onChar)
+    {
+    /**
+     * @brief Stage 2: calls onChar(pos, isNewline) for every comma and newline outside quotes,
+     * in text order
+     *
+     * @param text - CSV text
+     * @param onChar - per-character callback
+     */
+        scanBlocks(text, [&](size_t offset, uint64_t commas, uint64_t newlines) {
+            for (uint64_t bits = commas | newlines; bits != 0; bits &= bits - 1)
+            {
+                const int bit = __builtin_ctzll(bits);
+                onChar(offset + bit, ((newlines >> bit) & 1) != 0);
+            }
+            return true;
+        });
+    }
+
+    size_t rowBoundaryAfter(std::string_view text, size_t from)
+    {
+    /**
+     * @brief Length of the shortest prefix of text that is at least from bytes long and ends
+     * with a row, i.e. just past a newline outside quotes (text.size() if there is none)
+     *
+     * @param text - CSV text
+     * @param from - smallest prefix length wanted
+     */
+        size_t boundary = text.size();
+        scanBlocks(text, [&](size_t offset, uint64_t, uint64_t newlines) {
+            if (offset + 64 <= from)
+            {
+                return true;
+            }
+            if (from > offset)
+            {
+                newlines &= ~uint64_t(0) << (from - offset);
+            }
+            if (newlines == 0)
+            {
+                return true;
+            }
+            boundary = std::min(text.size(), offset + __builtin_ctzll(newlines) + 1);
+            return false;
+        });
+        return boundary;
+    }
+
+    size_t lastRowBoundary(std::string_view text)
+    {
+    /**
+     * @brief Length of the longest prefix of text that ends just past a newline outside
+     * quotes (0 if there is none)
+     *
+     * @param text - CSV text
+     */
+        size_t boundary = 0;
+        scanBlocks(text, [&](size_t offset, uint64_t, uint64_t newlines) {
+            if (newlines != 0)
+            {
+                boundary = offset + 63 - __builtin_clzll(newlines) + 1;
+            }
+            return true;
+        });
+        return boundary;
+    }
+
+private:
+    static constexpr size_t WINDOW_BLOCKS = 256;    // 16 KiB of text per stage 1 window
+
+    CsvBlockMasks classifyOne(const char *p) const
+    {
+#ifdef PLAYLIST_CSV_X86
+        if (path_ == CsvScanPath::AVX2)
+        {
+            return classifyCsvBlockAVX2(p);
+        }
+        if (path_ == CsvScanPath::SSE2)
+        {
+            return classifyCsvBlockSSE2(p);
+        }
+#endif
+        return classifyCsvBlockScalar(p);
+    }
+
+    void classify(const char *p, size_t blocks)
+    {
+#ifdef PLAYLIST_CSV_X86
+        if (path_ == CsvScanPath::AVX2)
+        {
+            classifyCsvWindowAVX2(p, blocks, masks_.data());
+            return;
+        }
+        if (path_ == CsvScanPath::SSE2)
+        {
+            classifyCsvWindowSSE2(p, blocks, masks_.data());
+            return;
+        }
+#endif
+        for (size_t b = 0; b < blocks; ++b)
+        {
+            masks_[b] = classifyCsvBlockScalar(p + 64 * b);
+        }
+    }
+
+    CsvScanPath path_;
+    std::array<CsvBlockMasks, WINDOW_BLOCKS> masks_;
+};
+
+#endif // PLAYLIST_CSV_TOKENIZER_H
@@ -0,0 +1,163 @@
+/**
+ * @file dedup.h
+ * @brief Collapses songs that appear more than once across CSV files, keyed on normalized
+ * (title, artist). Parse workers offer every row to a sharded concurrent hash table whose
+ * entry per key remembers the best row seen so far under the policy; ties are always broken by
+ * file order, so the survivor of every key is the same for any number of threads and any
+ * parse timing. Once every row has been offered, a row is kept only if it is its key's
+ * survivor.
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef PLAYLIST_DEDUP_H
+#define PLAYLIST_DEDUP_H
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "song.h"
+#include "string_arena.h"
+#include "title_index.h"
+
+/**
+ * @brief Which copy of a duplicated song survives
+ *
+ */
+enum class DedupPolicy
+{
+    None,           // keep every row
+    KeepFirst,      // the first copy in file order
+    MostPopular,    // the copy with the highest pop (first on ties)
+    Latest          // the copy with the latest year (first on ties)
+};
+
+inline bool parseDedupPolicy(const std::string &name, DedupPolicy &policy)
+{
+/**
+ * @brief Parses "none", "first", "popular" or "latest"
+ *
+ * @param name - policy name
+ * @param policy - receives the policy
+ * @return false if the name is unknown
+ */
+    if (name == "none") { policy = DedupPolicy::None; return true; }
+    if (name == "first") { policy = DedupPolicy::KeepFirst; return true; }
+    if (name == "popular") { policy = DedupPolicy::MostPopular; return true; }
+    if (name == "latest") { policy = DedupPolicy::Latest; return true; }
+    return false;
+}
+
+/**
+ * @brief Counters for one deduplication run
+ *
+ */
+struct DedupStats
+{
+    size_t rows = 0;            // rows offered
+    size_t duplicates = 0;      // rows dropped because a better copy exists
+    size_t bytesSaved = 0;      // Song and string bytes the dropped rows would have held
+};
+
+/**
+ * @brief Best copy per (title, artist) key; safe to offer rows from several threads at once
+ *
+ */
+class SongDeduplicator
+{
+public:
+    /**
+     * @brief The survivor of one key. Entries never move once created, so parse workers can
+     * keep a pointer per row and check it after every row has been offered.
+     *
+     */
+    struct Entry
+    {
+        uint64_t seq;       // file-order position of the current best row
+        int rank;           // the policy's measure for that row; higher wins
+    };
+
+    explicit SongDeduplicator(DedupPolicy policy) : policy_(policy), shards_(SHARDS) {}
+
+    DedupPolicy policy() const { return policy_; }
+
+    const Entry *offer(const Song &song, uint64_t seq)
+    {
+    /**
+     * @brief Offers one row. Thread-safe: only the key's shard is locked.
+     *
+     * @param song - parsed row
+     * @param seq - position of the row in file order; smaller is earlier
+     * @return the key's entry, to pass to keeps() once every row has been offered
+     */
+        std::string key = normalizeKey(song.title);
+        key.push_back('\n');    // cannot occur in a normalized title, so the pair is unambiguous
+        key += normalizeKey(song.artist);
+        const int rank = policy_ == DedupPolicy::MostPopular ? song.pop
+                       : policy_ == DedupPolicy::Latest ? song.year : 0;
+
+        Shard &shard = shards_[hashKey(key) % SHARDS];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto inserted = shard.entries.emplace(std::move(key), Entry{seq, rank});
+        Entry &entry = inserted.first->second;
+        if (!inserted.second && (rank > entry.rank || (rank == entry.rank && seq < entry.seq)))
+        {
+            entry = Entry{seq, rank};
+        }
+        return &entry;
+    }
+
+    static bool keeps(const Entry *entry, uint64_t seq)
+    {
+    /**
+     * @brief Whether the row offered as seq survives; only meaningful after every row has
+     * been offered
+     */
+        return entry->seq == seq;
+    }
+
+    static size_t songBytes(const Song &song)
+    {
+    /**
+     * @brief Bytes a Song occupies in a vector<Song>, counting string text outside the
+     * small-string buffer
+     */
+        size_t bytes = sizeof(Song);
+        for (const std::string *text : {&song.title, &song.artist, &song.genre})
+        {
+            bytes += text->capacity() > SMALL_STRING ? text->capacity() + 1 : 0;
+        }
+        return bytes;
+    }
+
+    size_t keys() const
+    {
+        size_t total = 0;
+        for (const Shard &shard : shards_)
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            total += shard.entries.size();
+        }
+        return total;
+    }
+
+private:
+    static constexpr size_t SHARDS = 64;
+    static constexpr size_t SMALL_STRING = sizeof(std::string) - sizeof(size_t) - 1;
+
+    struct Shard
+    {
+        mutable std::mutex mutex;
+        std::unordered_map<std::string, Entry> entries;
+    };
+
+    DedupPolicy policy_;
+    std::vector<Shard> shards_;
+};
+
+#endif // PLAYLIST_DEDUP_H
@@ -0,0 +1,64 @@
+/**
+ * @file dj_score.h
+ * @authors Isha Bhatt (ibhatt), Mary Silvio (msilvio), Harsh Jhaveri (hjhaveri)
+ * @brief Reference dj_score metric and playlist ordering, shared by the playlist generator
+ * and the benchmarks that check faster paths against it.
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef PLAYLIST_DJ_SCORE_H
+#define PLAYLIST_DJ_SCORE_H
+
+#include <cmath>
+#include <cstdlib>
+
+#include "song.h"
+#include "song_schema.h"
+
+inline double calcDJScore(const Song &song, const Song &setpointSong)
+{
+/**
+ * @brief Function used to calculate dj_score for each Song object.
+ * Score is calculated based on a modified Mean Squared Error, thus a lower score
+ * is better
+ *
+ * @param song - Song object to calculate dj_score for
+ * @param setpointSong - Song object to compare song to in calculations
+ */
+    // Create base score variable
+    double dj_score = 0;
+
+    // Update score, one term per feature of the schema
+    forEachFeature([&](auto k) {
+        dj_score += std::pow(std::abs(feature<k>(setpointSong) - feature<k>(song)), 2);
+    });
+
+    // Return score
+    return std::sqrt(dj_score);
+}
+
+inline bool compareSong(const Song &song1, const Song &song2)
+{
+/**
+ * @brief Custom comparator used to compare the dj_score of all songs.
+ * Will sort the songs in ascending order based on dj_score. If the dj_score
+ * is within 0.0005 of another song, then songs are sorted based on artist name.
+ *
+ * @param song1 - the first song to compare
+ * @param song2 - the second song to compare the first song to
+ */
+    // First sort by minimizing the DJ score
+    if (std::abs(song1.dj_score-song2.dj_score) > 0.0005)
+    {
+        return song1.dj_score < song2.dj_score;
+    }
+    // If ties exist, alphabetize by the artist's name
+    else
+    {
+        return song1.artist < song2.artist;
+    }
+}
+
+#endif // PLAYLIST_DJ_SCORE_H
@@ -0,0 +1,94 @@
+/**
+ * @file dj_set.h
+ * @brief DJ set sequencing: orders songs as a path instead of by distance to one seed.
+ * Starting from the seed, each next track is the nearest unused song to the previous track
+ * under the dj_score metric, optionally only among songs within a maximum bpm jump. Used songs
+ * are removed from a k-d tree, so every step is one nearest-neighbour query over what is left
+ * and a whole chain costs about O(N log N) instead of the O(N^2) of rescanning the catalog.
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef PLAYLIST_DJ_SET_H
+#define PLAYLIST_DJ_SET_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "song.h"
+#include "song_table.h"
+#include "score_kernels.h"
+#include "kd_tree.h"
+
+/**
+ * @brief Counters for one sequencing run
+ *
+ */
+struct DjSetStats
+{
+    size_t tracks = 0;
+    size_t nodesVisited = 0;    // k-d tree nodes touched over all steps
+    double totalDistance = 0;   // sum of the dj_score of every transition
+    double maxDistance = 0;     // largest single transition
+    bool stoppedByBpm = false;  // ended early: no unused song within the bpm jump
+};
+
+inline void sequenceDjSet(const SongTable &table, KdTree &tree, const Song &seedSong, size_t length,
+                          int maxBpmJump, std::vector<uint32_t> &order, std::vector<double> &transitions,
+                          DjSetStats &stats)
+{
+/**
+ * @brief Chains nearest unused neighbours into a set. The first track is the song closest to
+ * the seed (the seed itself when it is in the catalog); every later track is the song closest
+ * to the track before it. Ties are broken by artist, as in every other ranking.
+ *
+ * @param table - catalog the tree was built over
+ * @param tree - k-d tree over table; every chosen row is removed from it
+ * @param seedSong - Song object the set starts from
+ * @param length - tracks wanted (0 = every song)
+ * @param maxBpmJump - largest allowed bpm change between consecutive tracks (negative = no limit)
+ * @param order - receives the set's rows in play order
+ * @param transitions - resized to one entry per row; transitions[row] is the dj_score between
+ *                      the row and the track before it (for the first track, the seed)
+ * @param stats - receives counters for the run
+ */
+    stats = DjSetStats();
+    order.clear();
+    transitions.resize(table.size());
+    if (length == 0 || length > tree.liveCount())
+    {
+        length = tree.liveCount();
+    }
+    order.reserve(length);
+
+    constexpr int BPM = featureIndex("bpm");
+    ScoreSetpoint previous(seedSong);
+    std::vector<Neighbour> next;
+    while (order.size() < length)
+    {
+        size_t visited = 0;
+        FeatureWindow bpmWindow{BPM, previous.value[BPM] - maxBpmJump, previous.value[BPM] + maxBpmJump};
+        tree.nearest(previous, 1, next, &visited, maxBpmJump >= 0 ? &bpmWindow : nullptr);
+        stats.nodesVisited += visited;
+        if (next.empty())
+        {
+            stats.stoppedByBpm = true;
+            break;
+        }
+        uint32_t row = next[0].row;
+        double distance = std::sqrt(static_cast<double>(next[0].dist2));
+        tree.remove(row);
+        order.push_back(row);
+        transitions[row] = distance;
+        stats.totalDistance += distance;
+        stats.maxDistance = std::max(stats.maxDistance, distance);
+        previous = ScoreSetpoint(table, row);
+    }
+    stats.tracks = order.size();
+}
+
+#endif // PLAYLIST_DJ_SET_H
@@ -0,0 +1,279 @@
+/**
+ * @file early_abandon.h
+ * @brief Exact top-K scan that stops summing a row's squared differences as soon as the row
+ * cannot make the playlist. Rows are scored a block at a time against the current K-th best
+ * distance: the block's rows add one feature at a time, and after each feature the rows whose
+ * partial sum is already strictly greater than that threshold are dropped. The remaining terms
+ * can only add to the sum, so a dropped row could never have entered the top K, and rows tied
+ * with the threshold survive to be compared by artist: the result is exactly topKRows'.
+ *
+ * Features are summed in order of decreasing expected contribution, so most rows are dropped
+ * after the first few terms. The catalog's mean and variance of each feature are measured once;
+ * a row's expected squared difference from a setpoint value s is variance + (mean - s)^2, which
+ * orders the features per query with one multiply-add per feature.
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef PLAYLIST_EARLY_ABANDON_H
+#define PLAYLIST_EARLY_ABANDON_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "song.h"
+#include "song_table.h"
+#include "score_kernels.h"
+#include "kd_tree.h"
+
+/**
+ * @brief Work done by early-abandoning queries
+ *
+ */
+struct EarlyAbandonStats
+{
+    size_t rowsScored = 0;          // rows that had at least one feature summed
+    size_t featuresEvaluated = 0;   // squared differences summed over all of those rows
+
+    double featuresPerSong() const
+    {
+        return rowsScored > 0 ? double(featuresEvaluated) / double(rowsScored) : 0.0;
+    }
+};
+
+template <typename T>
+void squaredDiffRun(const T *column, int setpoint, size_t count, int64_t *partial)
+{
+/**
+ * @brief partial[j] = (setpoint - column[j])^2 for a run of consecutive rows; a contiguous
+ * loop the compiler can vectorize
+ *
+ * @param column - feature column, from the run's first row
+ * @param setpoint - setpoint value of the feature
+ * @param count - rows in the run
+ * @param partial - receives one squared difference per row
+ */
+    for (size_t j = 0; j < count; ++j)
+    {
+        const int64_t diff = int64_t(setpoint) - column[j];
+        partial[j] = diff * diff;
+    }
+}
+
+template <typename T>
+void addSquaredDiffs(const T *column, int setpoint, const uint32_t *rows, size_t count, int64_t *partial)
+{
+/**
+ * @brief partial[j] += (setpoint - column[rows[j]])^2 for the first count surviving rows
+ *
+ * @param column - feature column
+ * @param setpoint - setpoint value of the feature
+ * @param rows - surviving rows of the block
+ * @param count - number of surviving rows
+ * @param partial - running sums, parallel to rows
+ */
+    for (size_t j = 0; j < count; ++j)
+    {
+        const int64_t diff = int64_t(setpoint) - column[rows[j]];
+        partial[j] += diff * diff;
+    }
+}
+
+/**
+ * @brief Early-abandoning top-K queries over a SongTable, with the unweighted dj_score
+ *
+ */
+class EarlyAbandonScorer
+{
+public:
+    // Rows scored against one threshold; the K-th best distance is refreshed between blocks
+    static constexpr size_t BLOCK_ROWS = 256;
+
+    void build(const SongTable &table)
+    {
+    /**
+     * @brief Measures every feature's mean and variance. The table must outlive the scorer.
+     *
+     * @param table - catalog to query
+     */
+        table_ = &table;
+        forEachFeature([&](auto k) { measure(k, table.column<k>()); });
+    }
+
+    double variance(int k) const { return variance_[k]; }
+
+    void featureOrder(const ScoreSetpoint &sp, int order[SCORE_FEATURES]) const
+    {
+    /**
+     * @brief Kernel feature indices by decreasing expected squared difference from sp
+     *
+     * @param sp - setpoint features
+     * @param order - receives SCORE_FEATURES indices
+     */
+        double expected[SCORE_FEATURES];
+        for (int k = 0; k < SCORE_FEATURES; ++k)
+        {
+            const double bias = mean_[k] - sp.value[k];
+            expected[k] = variance_[k] + bias * bias;
+            order[k] = k;
+        }
+        std::stable_sort(order, order + SCORE_FEATURES, [&](int a, int b) { return expected[a] > expected[b]; });
+    }
+
+    void nearest(const ScoreSetpoint &sp, size_t k, std::vector<Neighbour> &result,
+                 EarlyAbandonStats *stats = nullptr) const
+    {
+    /**
+     * @brief The k rows closest to the setpoint, ordered by distance then artist. Safe to
+     * call from several threads at once.
+     *
+     * @param sp - setpoint features
+     * @param k - number of neighbours
+     * @param result - receives min(k, rows) neighbours, best first
+     * @param stats - optional counters for this query; totals() also accumulates them
+     */
+        result.clear();
+        const size_t n = table_ != nullptr ? table_->size() : 0;
+        k = std::min(k, n);
+        if (k == 0)
+        {
+            return;
+        }
+        int order[SCORE_FEATURES];
+        featureOrder(sp, order);
+
+        const SongText &text = table_->text;
+        auto less = [&text](const Neighbour &a, const Neighbour &b) {
+            if (a.dist2 != b.dist2)
+            {
+                return a.dist2 < b.dist2;
+            }
+            return text.artistLess(a.row, b.row);
+        };
+
+        // The heap's front is the worst row kept so far. Rows are offered in row order with
+        // the same heap operations as selectTopK, and a dropped row is one selectTopK would
+        // not have pushed, so ties resolve identically.
+        result.reserve(k);
+        uint32_t rows[BLOCK_ROWS];
+        int64_t partial[BLOCK_ROWS];
+        EarlyAbandonStats local;
+        for (size_t begin = 0; begin < n; begin += BLOCK_ROWS)
+        {
+            const size_t end = std::min(n, begin + BLOCK_ROWS);
+            const int64_t threshold = result.size() < k ? std::numeric_limits<int64_t>::max()
+                                                         : result.front().dist2;
+            // the first feature reads the block's rows in place; the rest only the survivors
+            size_t alive = 0;
+            firstFeature(order[0], sp, begin, end - begin, partial);
+            for (size_t j = 0; j < end - begin; ++j)
+            {
+                rows[alive] = static_cast<uint32_t>(begin + j);
+                partial[alive] = partial[j];
+                alive += partial[j] <= threshold;
+            }
+            local.rowsScored += end - begin;
+            local.featuresEvaluated += end - begin;
+            for (int f = 1; f < SCORE_FEATURES && alive > 0; ++f)
+            {
+                addFeature(order[f], sp, rows, alive, partial);
+                local.featuresEvaluated += alive;
+                size_t kept = 0;
+                for (size_t j = 0; j < alive; ++j)
+                {
+                    rows[kept] = rows[j];
+                    partial[kept] = partial[j];
+                    kept += partial[j] <= threshold;
+                }
+                alive = kept;
+            }
+
+            for (size_t j = 0; j < alive; ++j)
+            {
+                const Neighbour candidate{partial[j], rows[j]};
+                if (result.size() < k)
+                {
+                    result.push_back(candidate);
+                    std::push_heap(result.begin(), result.end(), less);
+                }
+                else if (less(candidate, result.front()))
+                {
+                    std::pop_heap(result.begin(), result.end(), less);
+                    result.back() = candidate;
+                    std::push_heap(result.begin(), result.end(), less);
+                }
+            }
+        }
+        std::sort_heap(result.begin(), result.end(), less);
+
+        rowsScored_ += local.rowsScored;
+        featuresEvaluated_ += local.featuresEvaluated;
+        if (stats != nullptr)
+        {
+            *stats = local;
+        }
+    }
+
+    EarlyAbandonStats totals() const
+    {
+    /**
+     * @brief Counters summed over every query so far
+     */
+        EarlyAbandonStats total;
+        total.rowsScored = rowsScored_.load();
+        total.featuresEvaluated = featuresEvaluated_.load();
+        return total;
+    }
+
+private:
+    template <typename T>
+    void measure(int k, const std::vector<T> &column)
+    {
+        // two passes: the mean, then the squared deviations from it
+        double sum = 0;
+        for (T value : column)
+        {
+            sum += value;
+        }
+        mean_[k] = column.empty() ? 0.0 : sum / double(column.size());
+        double squares = 0;
+        for (T value : column)
+        {
+            squares += (value - mean_[k]) * (value - mean_[k]);
+        }
+        variance_[k] = column.empty() ? 0.0 : squares / double(column.size());
+    }
+
+    void firstFeature(int f, const ScoreSetpoint &sp, size_t begin, size_t count, int64_t *partial) const
+    {
+        forEachFeature([&](auto k) {
+            if (k == f)
+            {
+                squaredDiffRun(table_->column<k>().data() + begin, sp.value[k], count, partial);
+            }
+        });
+    }
+
+    void addFeature(int f, const ScoreSetpoint &sp, const uint32_t *rows, size_t count, int64_t *partial) const
+    {
+        forEachFeature([&](auto k) {
+            if (k == f)
+            {
+                addSquaredDiffs(table_->column<k>().data(), sp.value[k], rows, count, partial);
+            }
+        });
+    }
+
+    const SongTable *table_ = nullptr;
+    double mean_[SCORE_FEATURES] = {};
+    double variance_[SCORE_FEATURES] = {};
+    mutable std::atomic<size_t> rowsScored_{0};
+    mutable std::atomic<size_t> featuresEvaluated_{0};
+};
+
+#endif // PLAYLIST_EARLY_ABANDON_H
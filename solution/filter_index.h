@@ -0,0 +1,453 @@
+/**
+ * @file filter_index.h
+ * @brief Filter predicates on song fields, evaluated into row bitmaps before any scoring.
+ * Genre, year, bpm and pop have a bucketed index (rows grouped by value, one sorted row list
+ * per genre id or value), so a predicate costs one pass over the rows it matches rather than
+ * over the catalog, and the index holds four bytes per row per indexed field whatever the
+ * number of genres. A bucket is only expanded into a bitmap when a query selects it. The other
+ * features and artist are answered by scanning their column. Predicates in a clause are ANDed
+ * and clauses are ORed, both as word-wide bitmap operations. Genre and artist values are
+ * normalized the way titles are (case-folded, whitespace trimmed and collapsed).
+ *
+ * Syntax: clauses are separated by ';', predicates by ','. A predicate is name=values with
+ * alternatives separated by '|'. Numeric values are a number or a range lo..hi (either end may
+ * be left open). Example: "genre=dance pop|pop,year=1995..2005;bpm=120..130"
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef PLAYLIST_FILTER_INDEX_H
+#define PLAYLIST_FILTER_INDEX_H
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "song_table.h"
+#include "score_weights.h"
+#include "string_arena.h"
+#include "title_index.h"
+
+/**
+ * @brief One bit per catalog row
+ *
+ */
+class RowBitmap
+{
+public:
+    explicit RowBitmap(size_t rows = 0, bool value = false) { assign(rows, value); }
+
+    void assign(size_t rows, bool value)
+    {
+        rows_ = rows;
+        words_.assign((rows + 63) / 64, value ? ~0ULL : 0);
+        if (value && rows % 64 != 0)
+        {
+            words_.back() = (1ULL << (rows % 64)) - 1;     // bits past the last row stay clear
+        }
+    }
+
+    size_t size() const { return rows_; }
+    void set(size_t row) { words_[row >> 6] |= 1ULL << (row & 63); }
+    bool test(size_t row) const { return (words_[row >> 6] >> (row & 63)) & 1; }
+
+    RowBitmap &operator&=(const RowBitmap &other)
+    {
+        for (size_t w = 0; w < words_.size(); ++w)
+        {
+            words_[w] &= other.words_[w];
+        }
+        return *this;
+    }
+
+    RowBitmap &operator|=(const RowBitmap &other)
+    {
+        for (size_t w = 0; w < words_.size(); ++w)
+        {
+            words_[w] |= other.words_[w];
+        }
+        return *this;
+    }
+
+    size_t count() const
+    {
+        size_t total = 0;
+        for (uint64_t word : words_)
+        {
+            total += static_cast<size_t>(__builtin_popcountll(word));
+        }
+        return total;
+    }
+
+    template <typename RunFn>
+    void forEachRun(RunFn &&fn) const
+    {
+    /**
+     * @brief Calls fn(begin, end) for every maximal run of set rows [begin, end), in row
+     * order, so dense selections can be scored a whole block at a time
+     *
+     * @param fn - callback per run
+     */
+        const size_t none = std::numeric_limits<size_t>::max();
+        size_t open = none;     // first row of the run in progress
+        for (size_t w = 0; w < words_.size(); ++w)
+        {
+            const uint64_t bits = words_[w];
+            const size_t base = w * 64;
+            int pos = 0;
+            while (pos < 64)
+            {
+                uint64_t rest = bits >> pos;
+                if (open != none)
+                {
+                    uint64_t clear = ~rest;
+                    int run = clear == 0 ? 64 : __builtin_ctzll(clear);
+                    if (pos + run >= 64)
+                    {
+                        break;      // the run carries on into the next word
+                    }
+                    fn(open, base + pos + run);
+                    open = none;
+                    pos += run;
+                }
+                else
+                {
+                    if (rest == 0)
+                    {
+                        break;
+                    }
+                    pos += __builtin_ctzll(rest);
+                    open = base + pos;
+                }
+            }
+        }
+        if (open != none)
+        {
+            fn(open, rows_);
+        }
+    }
+
+    size_t memoryBytes() const { return words_.size() * sizeof(uint64_t); }
+
+private:
+    size_t rows_ = 0;
+    std::vector<uint64_t> words_;
+};
+
+/**
+ * @brief Rows of one column grouped by value: the rows holding value v are
+ * rows[start[v - minValue] .. start[v - minValue + 1]), in ascending row order
+ *
+ */
+class ValueBuckets
+{
+public:
+    template <typename T>
+    void build(const std::vector<T> &column)
+    {
+        start_.assign(1, 0);
+        rows_.clear();
+        if (column.empty())
+        {
+            return;
+        }
+        auto range = std::minmax_element(column.begin(), column.end());
+        min_ = *range.first;
+        start_.assign(static_cast<size_t>(*range.second - min_) + 2, 0);
+        for (T value : column)
+        {
+            ++start_[static_cast<size_t>(value - min_) + 1];
+        }
+        for (size_t v = 1; v < start_.size(); ++v)
+        {
+            start_[v] += start_[v - 1];
+        }
+        std::vector<uint32_t> next(start_.begin(), start_.end() - 1);
+        rows_.resize(column.size());
+        for (size_t row = 0; row < column.size(); ++row)
+        {
+            rows_[next[static_cast<size_t>(column[row] - min_)]++] = static_cast<uint32_t>(row);
+        }
+    }
+
+    void select(long lo, long hi, RowBitmap &out) const
+    {
+    /**
+     * @brief Sets the rows whose value is in [lo, hi]
+     */
+        const long maxValue = min_ + static_cast<long>(start_.size()) - 2;
+        lo = std::max(lo, static_cast<long>(min_));
+        hi = std::min(hi, maxValue);
+        if (rows_.empty() || lo > hi)
+        {
+            return;
+        }
+        for (size_t pos = start_[lo - min_]; pos < start_[hi - min_ + 1]; ++pos)
+        {
+            out.set(rows_[pos]);
+        }
+    }
+
+    size_t memoryBytes() const { return (start_.size() + rows_.size()) * sizeof(uint32_t); }
+
+private:
+    int min_ = 0;
+    std::vector<uint32_t> start_;
+    std::vector<uint32_t> rows_;
+};
+
+inline std::string_view trimFilterToken(std::string_view text)
+{
+    while (!text.empty() && (text.front() == ' ' || text.front() == '\t'))
+    {
+        text.remove_prefix(1);
+    }
+    while (!text.empty() && (text.back() == ' ' || text.back() == '\t'))
+    {
+        text.remove_suffix(1);
+    }
+    return text;
+}
+
+template <typename Fn>
+void splitFilterList(std::string_view text, char separator, Fn &&fn)
+{
+/**
+ * @brief Calls fn(piece) for every separator-delimited piece of text, trimmed
+ */
+    while (true)
+    {
+        size_t end = text.find(separator);
+        fn(trimFilterToken(text.substr(0, end)));
+        if (end == std::string_view::npos)
+        {
+            return;
+        }
+        text.remove_prefix(end + 1);
+    }
+}
+
+inline bool parseFilterNumber(std::string_view text, long &value)
+{
+    std::string digits(text);
+    char *end = nullptr;
+    errno = 0;
+    value = std::strtol(digits.c_str(), &end, 10);
+    return !digits.empty() && *end == '\0' && errno == 0;
+}
+
+inline bool parseFilterRange(std::string_view text, long &lo, long &hi)
+{
+/**
+ * @brief Parses "v", "lo..hi", "lo.." or "..hi"
+ */
+    size_t dots = text.find("..");
+    if (dots == std::string_view::npos)
+    {
+        bool ok = parseFilterNumber(text, lo);
+        hi = lo;
+        return ok;
+    }
+    std::string_view from = trimFilterToken(text.substr(0, dots));
+    std::string_view to = trimFilterToken(text.substr(dots + 2));
+    lo = std::numeric_limits<long>::min();
+    hi = std::numeric_limits<long>::max();
+    return (from.empty() || parseFilterNumber(from, lo)) && (to.empty() || parseFilterNumber(to, hi))
+        && !(from.empty() && to.empty());
+}
+
+/**
+ * @brief Bucketed genre and feature indexes over one SongTable
+ *
+ */
+class FilterIndex
+{
+public:
+    void build(const SongTable &table)
+    {
+    /**
+     * @brief Indexes the table, which must outlive the index
+     *
+     * @param table - catalog to filter
+     */
+        table_ = &table;
+        genre_.build(table.text.genreId);
+        year_.build(table.column<YEAR>());
+        bpm_.build(table.column<BPM>());
+        pop_.build(table.column<POP>());
+    }
+
+    size_t memoryBytes() const
+    {
+        return genre_.memoryBytes() + year_.memoryBytes() + bpm_.memoryBytes() + pop_.memoryBytes();
+    }
+
+    bool evaluate(std::string_view expression, RowBitmap &result, std::string &error) const
+    {
+    /**
+     * @brief Rows that satisfy a filter expression (see the file comment for the syntax)
+     *
+     * @param expression - filter expression
+     * @param result - receives the matching rows
+     * @param error - receives a message when the expression is malformed
+     * @return false if the expression is malformed
+     */
+        result.assign(table_->size(), false);
+        bool ok = true;
+        splitFilterList(expression, ';', [&](std::string_view clause) {
+            RowBitmap matches(table_->size(), true);
+            splitFilterList(clause, ',', [&](std::string_view predicate) {
+                RowBitmap rows(table_->size());
+                ok = ok && evaluatePredicate(predicate, rows, error);
+                matches &= rows;
+            });
+            result |= matches;
+        });
+        return ok;
+    }
+
+private:
+    bool evaluatePredicate(std::string_view predicate, RowBitmap &out, std::string &error) const
+    {
+    /**
+     * @brief Sets the rows matching one name=values predicate
+     */
+        size_t eq = predicate.find('=');
+        if (eq == std::string_view::npos)
+        {
+            error = "Filter predicate \"" + std::string(predicate) + "\" should look like name=value";
+            return false;
+        }
+        std::string_view name = trimFilterToken(predicate.substr(0, eq));
+        std::string_view values = predicate.substr(eq + 1);
+        const SongText &text = table_->text;
+
+        if (name == "genre")
+        {
+            for (uint32_t id : matchingIds(text.genres, values))
+            {
+                genre_.select(id, id, out);
+            }
+            return true;
+        }
+        if (name == "artist")
+        {
+            std::vector<uint32_t> ids = matchingIds(text.artists, values);
+            std::sort(ids.begin(), ids.end());
+            for (size_t row = 0; !ids.empty() && row < table_->size(); ++row)
+            {
+                if (std::binary_search(ids.begin(), ids.end(), text.artistId[row]))
+                {
+                    out.set(row);
+                }
+            }
+            return true;
+        }
+
+        int feature = 0;
+        while (feature < SCORE_FEATURES && name != SONG_FEATURES[feature].name)
+        {
+            ++feature;
+        }
+        if (feature == SCORE_FEATURES)
+        {
+            error = "Unknown filter field \"" + std::string(name) + "\" (expected genre, artist or a feature name)";
+            return false;
+        }
+        bool ok = true;
+        splitFilterList(values, '|', [&](std::string_view range) {
+            long lo = 0;
+            long hi = 0;
+            if (!parseFilterRange(range, lo, hi))
+            {
+                error = "Bad filter range \"" + std::string(range) + "\" for " + std::string(name)
+                    + " (expected v, lo..hi, lo.. or ..hi)";
+                ok = false;
+                return;
+            }
+            selectFeature(feature, lo, hi, out);
+        });
+        return ok;
+    }
+
+    std::vector<uint32_t> matchingIds(const StringDictionary &dictionary, std::string_view values) const
+    {
+    /**
+     * @brief Ids of the dictionary entries whose normalized name equals one of the
+     * '|'-separated values, normalized the same way; several spellings can share a key
+     *
+     * @param dictionary - genres or artists of the table
+     * @param values - predicate values
+     */
+        std::vector<std::string> keys;
+        splitFilterList(values, '|', [&](std::string_view value) { keys.push_back(normalizeKey(value)); });
+        std::vector<uint32_t> ids;
+        for (uint32_t id = 0; id < dictionary.size(); ++id)
+        {
+            const std::string name = normalizeKey(dictionary.name(table_->text.arena, id));
+            if (std::find(keys.begin(), keys.end(), name) != keys.end())
+            {
+                ids.push_back(id);
+            }
+        }
+        return ids;
+    }
+
+    void selectFeature(int feature, long lo, long hi, RowBitmap &out) const
+    {
+        const SongTable &t = *table_;
+        if (feature == YEAR)
+        {
+            year_.select(lo, hi, out);
+        }
+        else if (feature == BPM)
+        {
+            bpm_.select(lo, hi, out);
+        }
+        else if (feature == POP)
+        {
+            pop_.select(lo, hi, out);
+        }
+        else
+        {
+            forEachFeature([&](auto k) {
+                if (k == feature)
+                {
+                    scanColumn(t.column<k>(), lo, hi, out);
+                }
+            });
+        }
+    }
+
+    template <typename T>
+    static void scanColumn(const std::vector<T> &column, long lo, long hi, RowBitmap &out)
+    {
+        for (size_t row = 0; row < column.size(); ++row)
+        {
+            if (column[row] >= lo && column[row] <= hi)
+            {
+                out.set(row);
+            }
+        }
+    }
+
+    // Features with a bucketed index; the others are answered by scanning their column
+    static constexpr int YEAR = featureIndex("year");
+    static constexpr int BPM = featureIndex("bpm");
+    static constexpr int POP = featureIndex("pop");
+
+    const SongTable *table_ = nullptr;
+    ValueBuckets genre_;                // rows per genre id
+    ValueBuckets year_;
+    ValueBuckets bpm_;
+    ValueBuckets pop_;
+};
+
+#endif // PLAYLIST_FILTER_INDEX_H
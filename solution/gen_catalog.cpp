@@ -0,0 +1,111 @@
+/**
+ * @file gen_catalog.cpp
+ * @brief Writes a deterministic synthetic catalog fitted to the decade CSVs, either as one CSV
+ * or as a directory of shards that can be loaded with --dir.
+ *
+ * Build: g++ -std=c++17 -O2 gen_catalog.cpp -o gen_catalog
+ * Usage: ./gen_catalog ROWS OUTPUT [--seed N] [--shards N] [--sample DIR]
+ *   OUTPUT is a CSV file, or a directory when --shards is greater than 1.
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+
+#include "song.h"
+#include "playlist_io.h"
+#include "synthetic_catalog.h"
+
+using namespace std;
+
+int main(int argc, char *argv[])
+{
+    if (argc < 3)
+    {
+        cerr << "Usage: " << argv[0] << " ROWS OUTPUT [--seed N] [--shards N] [--sample DIR]" << endl;
+        return 1;
+    }
+    uint64_t rows = strtoull(argv[1], nullptr, 10);
+    string output = argv[2];
+    uint64_t seed = 1;
+    uint64_t shards = 1;
+    string sampleDir = "../student_code";
+    for (int i = 3; i < argc; ++i)
+    {
+        string arg = argv[i];
+        if (arg == "--seed" && i + 1 < argc)
+        {
+            seed = strtoull(argv[++i], nullptr, 10);
+        }
+        else if (arg == "--shards" && i + 1 < argc)
+        {
+            shards = max<uint64_t>(1, strtoull(argv[++i], nullptr, 10));
+        }
+        else if (arg == "--sample" && i + 1 < argc)
+        {
+            sampleDir = argv[++i];
+        }
+        else
+        {
+            cerr << "Unknown option " << arg << endl;
+            return 1;
+        }
+    }
+
+    vector<Song> sample;
+    for (const char *name : {"1990.csv", "2000.csv", "2010.csv"})
+    {
+        ifstream inFile(sampleDir + "/" + name);
+        if (!inFile)
+        {
+            cerr << "Could not open " << sampleDir + "/" + name << endl;
+            return 1;
+        }
+        readFile(inFile, sample);
+    }
+    if (sample.empty())
+    {
+        cerr << "No sample songs to fit the generator to" << endl;
+        return 1;
+    }
+    SyntheticCatalog catalog(sample, seed);
+
+    auto start = chrono::steady_clock::now();
+    uint64_t bytes = 0;
+    if (shards > 1)
+    {
+        mkdir(output.c_str(), 0755);
+    }
+    for (uint64_t shard = 0; shard < shards; ++shard)
+    {
+        // Shards split the rows evenly and keep the row numbering of the single-file catalog
+        uint64_t first = rows * shard / shards;
+        uint64_t last = rows * (shard + 1) / shards;
+        string path = output;
+        if (shards > 1)
+        {
+            string number = to_string(shard);
+            path += "/shard_" + string(number.size() < 5 ? 5 - number.size() : 0, '0') + number + ".csv";
+        }
+        ofstream outFile(path, ios::binary);
+        if (!outFile)
+        {
+            cerr << "Could not create " << path << endl;
+            return 1;
+        }
+        catalog.writeCsv(outFile, first, last - first);
+        bytes += static_cast<uint64_t>(outFile.tellp());
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cerr << "Wrote " << rows << " songs (" << bytes / 1e6 << " MB) to " << output << " in " << seconds << " s ("
+         << static_cast<long long>(seconds > 0 ? rows / seconds : 0) << " songs/sec)" << endl;
+    return 0;
+}
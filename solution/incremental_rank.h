@@ -0,0 +1,362 @@
+/**
+ * @file incremental_rank.h
+ * @brief Incremental re-ranking of a SongTable while one setpoint feature is nudged.
+ * The ranker keeps every row's squared distance inside its entry of the current order. When
+ * feature k moves from v to v', each row's distance changes by (v'-x)^2 - (v-x)^2, which is a
+ * single column pass. That change depends only on the row's value x, so rows that share an x
+ * keep their relative order: splitting the old order by x (a stable counting pass) gives runs
+ * that are already sorted under the new setpoint, and a k-way merge of those runs repairs the
+ * full order without sorting from scratch. Distances are exact integers, so the repaired order
+ * is identical to a full re-rank.
+ *
+ * The merge is resumable: a nudge can stop once the first K positions (the visible playlist)
+ * are final and finish the rest later with settle(), so slider latency is one column pass plus
+ * K merge steps rather than a full repair.
+ *
+ * Each entry is one 64-bit key, squared distance in the high half and the row's position in
+ * (artist, row) order in the low half, so every comparison in the merge is a single integer
+ * compare. The feature columns are copied into that tie order so the key alone addresses them.
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef PLAYLIST_INCREMENTAL_RANK_H
+#define PLAYLIST_INCREMENTAL_RANK_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "song.h"
+#include "song_table.h"
+#include "score_kernels.h"
+
+/**
+ * @brief Full ranking of a SongTable by squared distance, then artist, that follows
+ * single-feature setpoint changes without re-sorting
+ *
+ */
+class IncrementalRanker
+{
+public:
+    explicit IncrementalRanker(const SongTable &table)
+        : setpoint_(Song())
+    {
+    /**
+     * @param table - catalog to rank; only read during construction
+     */
+        const SongText &text = table.text;
+        const size_t n = table.size();
+        rowAt_.resize(n);
+        for (size_t i = 0; i < n; ++i)
+        {
+            rowAt_[i] = static_cast<uint32_t>(i);
+        }
+        // tie order: artist, then row, which is how equal distances are ranked
+        std::stable_sort(rowAt_.begin(), rowAt_.end(), [&text](uint32_t a, uint32_t b) {
+            return text.artistLess(a, b);
+        });
+        forEachFeature([&](auto k) { copyColumn(k, table.column<k>()); });
+    }
+
+    bool reset(const Song &setpointSong)
+    {
+    /**
+     * @brief Scores every row against a new setpoint and sorts from scratch
+     *
+     * @param setpointSong - Song object to compare rows to
+     * @return false (and nothing changes) if a distance could overflow 32 bits
+     */
+        ScoreSetpoint sp(setpointSong);
+        if (!fitsKey(sp))
+        {
+            return false;
+        }
+        setpoint_ = sp;
+        const size_t n = rowAt_.size();
+        keys_.assign(n, 0);
+        for (int k = 0; k < SCORE_FEATURES; ++k)
+        {
+            const int16_t *x = columns_[k].data();
+            const int64_t v = setpoint_.value[k];
+            for (size_t t = 0; t < n; ++t)
+            {
+                uint64_t diff = static_cast<uint64_t>(v - x[t]);
+                keys_[t] += diff * diff;
+            }
+        }
+        for (size_t t = 0; t < n; ++t)
+        {
+            keys_[t] = keys_[t] << 32 | t;
+        }
+        std::sort(keys_.begin(), keys_.end());
+        runs_ = 0;
+        merged_ = n;
+        return true;
+    }
+
+    bool setFeature(int k, int value, size_t ready = 0)
+    {
+    /**
+     * @brief Moves one setpoint feature and repairs the order
+     *
+     * @param k - feature index in kernel column order (see SONG_FEATURES)
+     * @param value - new setpoint value
+     * @param ready - if not 0, stop once this many leading positions are final and leave the
+     *                rest for settle()
+     * @return false (and nothing changes) if k is out of range or a distance could overflow
+     * 32 bits at the new value
+     */
+        if (k < 0 || k >= SCORE_FEATURES)
+        {
+            return false;
+        }
+        ScoreSetpoint sp = setpoint_;
+        sp.value[k] = value;
+        if (!fitsKey(sp))
+        {
+            return false;
+        }
+        settle();
+        runs_ = 0;
+        if (value != setpoint_.value[k])
+        {
+            shiftColumn(k, setpoint_.value[k], value);
+            setpoint_ = sp;
+            startMerge();
+            mergeUntil(ready > 0 ? ready : keys_.size());
+        }
+        return true;
+    }
+
+    // Finishes a repair that setFeature left partial
+    void settle() { mergeUntil(keys_.size()); }
+
+    // Leading positions of the ranking that are final; the rest wait for settle()
+    size_t ready() const { return merged_; }
+
+    const ScoreSetpoint &setpoint() const { return setpoint_; }
+    size_t size() const { return keys_.size(); }
+
+    // Row and squared distance at a position of the current ranking (position < ready())
+    uint32_t row(size_t position) const { return rowAt_[static_cast<uint32_t>(keys_[position])]; }
+    int64_t dist2(size_t position) const { return static_cast<int64_t>(keys_[position] >> 32); }
+
+    // Sorted runs merged by the last setFeature (0 after a full sort or a no-op)
+    size_t lastRunCount() const { return runs_; }
+
+    void playlist(size_t topK, std::vector<uint32_t> &order, std::vector<double> &scores)
+    {
+    /**
+     * @brief The current ranking in the form print_playlist takes, repairing only as much of it
+     * as the playlist needs
+     *
+     * @param topK - playlist length (0 = whole catalog)
+     * @param order - receives the playlist rows, best first
+     * @param scores - resized to one entry per row; scores[row] is the dj_score of every row in order
+     */
+        size_t count = topK > 0 ? std::min(topK, keys_.size()) : keys_.size();
+        mergeUntil(count);
+        order.resize(count);
+        scores.resize(rowAt_.size());
+        for (size_t i = 0; i < count; ++i)
+        {
+            order[i] = row(i);
+            scores[order[i]] = std::sqrt(static_cast<double>(dist2(i)));
+        }
+    }
+
+private:
+    template <typename T>
+    void copyColumn(int k, const std::vector<T> &column)
+    {
+        columns_[k].resize(rowAt_.size());
+        for (size_t t = 0; t < rowAt_.size(); ++t)
+        {
+            columns_[k][t] = static_cast<int16_t>(column[rowAt_[t]]);
+        }
+        min_[k] = 0;
+        max_[k] = 0;
+        if (!column.empty())
+        {
+            auto range = std::minmax_element(column.begin(), column.end());
+            min_[k] = *range.first;
+            max_[k] = *range.second;
+        }
+    }
+
+    bool fitsKey(const ScoreSetpoint &sp) const
+    {
+    /**
+     * @brief True if no row's squared distance to sp can exceed 32 bits
+     *
+     * @param sp - setpoint to check
+     */
+        int64_t worst = 0;
+        for (int k = 0; k < SCORE_FEATURES; ++k)
+        {
+            int64_t lo = sp.value[k] - static_cast<int64_t>(min_[k]);
+            int64_t hi = sp.value[k] - static_cast<int64_t>(max_[k]);
+            worst += std::max(lo * lo, hi * hi);
+        }
+        return worst <= static_cast<int64_t>(UINT32_MAX);
+    }
+
+    void shiftColumn(int k, int old, int value)
+    {
+    /**
+     * @brief Adds (value-x)^2 - (old-x)^2 = (value-old)(value+old-2x) to every row's distance,
+     * then stably splits the order into one run per column value x. Each run in scratch_ is
+     * followed by a UINT64_MAX sentinel, which no real key reaches since distances stay below
+     * 2^32.
+     *
+     * @param k - feature index
+     * @param old - previous setpoint value
+     * @param value - new setpoint value
+     */
+        const int64_t step = static_cast<int64_t>(value) - old;
+        const int64_t sum = static_cast<int64_t>(value) + old;
+        const int16_t *x = columns_[k].data();
+        const int lo = min_[k];
+        const size_t n = keys_.size();
+
+        bucket_.resize(n);
+        next_.assign(static_cast<size_t>(max_[k] - lo) + 1, 0);
+        for (size_t i = 0; i < n; ++i)
+        {
+            uint64_t key = keys_[i];
+            int v = x[static_cast<uint32_t>(key)];
+            keys_[i] = key + (static_cast<uint64_t>(step * (sum - 2 * v)) << 32);
+            uint16_t b = static_cast<uint16_t>(v - lo);
+            bucket_[i] = b;
+            ++next_[b];
+        }
+
+        // lay the non-empty values out as runs, each with room for its sentinel
+        head_.clear();
+        size_t offset = 0;
+        scratch_.resize(n + next_.size());
+        for (size_t &count : next_)
+        {
+            if (count > 0)
+            {
+                head_.push_back(scratch_.data() + offset);
+                scratch_[offset + count] = UINT64_MAX;
+                size_t start = offset;
+                offset += count + 1;
+                count = start;
+            }
+        }
+        runs_ = head_.size();
+
+        // stable counting scatter: each value's rows keep their old, still valid, relative order
+        uint64_t *runs = scratch_.data();
+        size_t *next = next_.data();
+        for (size_t i = 0; i < n; ++i)
+        {
+            runs[next[bucket_[i]]++] = keys_[i];
+        }
+    }
+
+    void startMerge()
+    {
+    /**
+     * @brief Builds a loser tree over the sentinel-terminated runs of scratch_. Each tree node
+     * holds the losing key itself, so replaying a match is a branchless select.
+     */
+        merged_ = 0;
+        if (runs_ <= 1)
+        {
+            std::copy(scratch_.begin(), scratch_.begin() + keys_.size(), keys_.begin());
+            merged_ = keys_.size();
+            return;
+        }
+
+        // padding leaves beyond the last run are empty runs that only hold a sentinel
+        leaves_ = 1;
+        while (leaves_ < runs_)
+        {
+            leaves_ *= 2;
+        }
+        static const uint64_t exhausted = UINT64_MAX;
+        head_.resize(leaves_, &exhausted);
+        std::vector<uint64_t> winnerKey(2 * leaves_);
+        std::vector<uint32_t> winnerRun(2 * leaves_);
+        for (size_t r = 0; r < leaves_; ++r)
+        {
+            winnerKey[leaves_ + r] = *head_[r];
+            winnerRun[leaves_ + r] = static_cast<uint32_t>(r);
+        }
+        loserKey_.assign(leaves_, UINT64_MAX);
+        loserRun_.assign(leaves_, 0);
+        for (size_t node = leaves_ - 1; node > 0; --node)
+        {
+            size_t a = 2 * node;
+            size_t b = 2 * node + 1;
+            bool bWins = winnerKey[b] < winnerKey[a];
+            winnerKey[node] = bWins ? winnerKey[b] : winnerKey[a];
+            winnerRun[node] = bWins ? winnerRun[b] : winnerRun[a];
+            loserKey_[node] = bWins ? winnerKey[a] : winnerKey[b];
+            loserRun_[node] = bWins ? winnerRun[a] : winnerRun[b];
+        }
+        winnerKey_ = winnerKey[1];
+        winnerRun_ = winnerRun[1];
+    }
+
+    void mergeUntil(size_t count)
+    {
+    /**
+     * @brief Continues the merge until the first count positions of keys_ are final
+     *
+     * @param count - positions wanted
+     */
+        uint64_t key = winnerKey_;
+        uint32_t run = winnerRun_;
+        const uint64_t **head = head_.data();
+        uint64_t *loserKey = loserKey_.data();
+        uint32_t *loserRun = loserRun_.data();
+        uint64_t *out = keys_.data();
+        for (; merged_ < count; ++merged_)
+        {
+            out[merged_] = key;
+            key = *++head[run];
+            for (size_t node = (leaves_ + run) / 2; node > 0; node /= 2)
+            {
+                // the outcome is a coin flip, so select with masks rather than a branch
+                uint64_t otherKey = loserKey[node];
+                uint64_t mask = 0 - static_cast<uint64_t>(otherKey < key);
+                uint64_t keyFlip = (key ^ otherKey) & mask;
+                uint32_t runFlip = (run ^ loserRun[node]) & static_cast<uint32_t>(mask);
+                loserKey[node] = otherKey ^ keyFlip;
+                key ^= keyFlip;
+                loserRun[node] ^= runFlip;
+                run ^= runFlip;
+            }
+        }
+        winnerKey_ = key;
+        winnerRun_ = run;
+    }
+
+    ScoreSetpoint setpoint_;
+    int min_[SCORE_FEATURES];
+    int max_[SCORE_FEATURES];
+    std::vector<uint32_t> rowAt_;               // row index per tie position
+    std::vector<int16_t> columns_[SCORE_FEATURES];  // features per tie position
+    std::vector<uint64_t> keys_;                // current ranking: dist2 << 32 | tie position
+    std::vector<uint64_t> scratch_;             // keys_ split into per-value runs
+    std::vector<uint16_t> bucket_;              // column value - min, per position in keys_
+    std::vector<size_t> next_;                  // per value: row count, then scatter position
+    std::vector<const uint64_t *> head_;        // merge cursor per run
+    std::vector<uint64_t> loserKey_;            // loser tree over the runs
+    std::vector<uint32_t> loserRun_;
+    uint64_t winnerKey_ = 0;                    // next key the merge will emit
+    uint32_t winnerRun_ = 0;
+    size_t leaves_ = 1;
+    size_t runs_ = 0;
+    size_t merged_ = 0;                         // leading positions of keys_ that are final
+};
+
+#endif // PLAYLIST_INCREMENTAL_RANK_H
@@ -0,0 +1,451 @@
+/**
+ * @file ingest.h
+ * @brief Pipelined, multi-threaded ingestion of many song CSV shards.
+ * Three stages run concurrently:
+ *   1. I/O: one thread maps each file, faults its pages in and cuts it into row-aligned chunks
+ *      (a newline inside a quoted field is not a cut point).
+ *   2. Parse: chunks are parsed into Songs by a work-stealing thread pool.
+ *   3. Merge: the calling thread hands parsed chunks to the caller strictly in (file, chunk)
+ *      order, so the merged catalog has the same row order for any number of threads.
+ * Workers take tasks oldest first, the order the merge needs them, and the I/O stage stops
+ * cutting chunks while a fixed number are queued or parsed but not yet merged, so memory
+ * stays bounded whatever the file size.
+ * With a SongDeduplicator, parse workers also offer each row to it, and the merge stage waits
+ * for every chunk before handing over only the surviving copy of each song.
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef PLAYLIST_INGEST_H
+#define PLAYLIST_INGEST_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <glob.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "song.h"
+#include "csv_mmap.h"
+#include "dedup.h"
+
+/**
+ * @brief Pool of worker threads with one task deque each. Owners pop from the front of their
+ * own deque and idle workers steal from the front of the others', so tasks start in roughly
+ * the order they were submitted.
+ *
+ */
+class WorkStealingPool
+{
+public:
+    explicit WorkStealingPool(unsigned threads)
+        : queues_(std::max(1u, threads))
+    {
+        for (size_t i = 0; i < queues_.size(); ++i)
+        {
+            workers_.emplace_back([this, i] { run(i); });
+        }
+    }
+
+    ~WorkStealingPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex_);
+            closed_ = true;
+        }
+        wake_.notify_all();
+        for (std::thread &worker : workers_)
+        {
+            worker.join();
+        }
+    }
+
+    WorkStealingPool(const WorkStealingPool &) = delete;
+    WorkStealingPool &operator=(const WorkStealingPool &) = delete;
+
+    void submit(std::function<void()> task)
+    {
+    /**
+     * @brief Queues a task; tasks are dealt round-robin across the worker deques
+     *
+     * @param task - work to run on some worker
+     */
+        Queue &queue = queues_[next_++ % queues_.size()];
+        {
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.tasks.push_back(std::move(task));
+        }
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex_);
+            ++queued_;
+        }
+        wake_.notify_one();
+    }
+
+    size_t threads() const { return queues_.size(); }
+    size_t steals() const { return steals_.load(); }
+
+    // Summed time workers spent running tasks
+    double busySeconds() const { return busyNanos_.load() * 1e-9; }
+
+private:
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    bool tryPop(size_t self, std::function<void()> &task)
+    {
+        {
+            Queue &own = queues_[self];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (!own.tasks.empty())
+            {
+                task = std::move(own.tasks.front());
+                own.tasks.pop_front();
+                return true;
+            }
+        }
+        for (size_t k = 1; k < queues_.size(); ++k)
+        {
+            Queue &victim = queues_[(self + k) % queues_.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.tasks.empty())
+            {
+                task = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+                ++steals_;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void run(size_t self)
+    {
+        std::function<void()> task;
+        while (true)
+        {
+            if (tryPop(self, task))
+            {
+                {
+                    std::lock_guard<std::mutex> lock(sleepMutex_);
+                    --queued_;
+                }
+                auto start = std::chrono::steady_clock::now();
+                task();
+                busyNanos_ += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - start).count();
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(sleepMutex_);
+            wake_.wait(lock, [this] { return queued_ > 0 || closed_; });
+            if (closed_ && queued_ == 0)
+            {
+                return;
+            }
+        }
+    }
+
+    std::vector<Queue> queues_;
+    std::vector<std::thread> workers_;
+    std::atomic<size_t> next_{0};
+    std::atomic<size_t> steals_{0};
+    std::atomic<long long> busyNanos_{0};
+    std::mutex sleepMutex_;
+    std::condition_variable wake_;
+    size_t queued_ = 0;     // tasks submitted but not yet popped, guarded by sleepMutex_
+    bool closed_ = false;   // guarded by sleepMutex_
+};
+
+/**
+ * @brief Per-stage counters and timings for one ingestion run
+ *
+ */
+struct IngestStats
+{
+    size_t files = 0;
+    size_t chunks = 0;
+    size_t bytes = 0;
+    size_t rows = 0;
+    size_t skipped = 0;
+    size_t steals = 0;
+    unsigned threads = 0;
+    double ioSeconds = 0;       // wall time of the I/O stage
+    double parseSeconds = 0;    // summed busy time of the parse workers
+    double mergeSeconds = 0;    // time the merge stage spent merging (not waiting)
+    double wallSeconds = 0;     // end to end
+    DedupStats dedup;           // filled when a deduplicator was given
+};
+
+inline std::vector<std::string> listCsvFiles(const std::string &pathOrPattern)
+{
+/**
+ * @brief Expands a directory (every *.csv inside it) or a glob pattern to a sorted file list
+ *
+ * @param pathOrPattern - directory such as "shards/" or pattern such as "shards/20*.csv"
+ */
+    std::string pattern = pathOrPattern;
+    struct stat st;
+    if (stat(pathOrPattern.c_str(), &st) == 0 && S_ISDIR(st.st_mode))
+    {
+        pattern = pathOrPattern + (pathOrPattern.back() == '/' ? "*.csv" : "/*.csv");
+    }
+
+    std::vector<std::string> files;
+    glob_t matches;
+    // glob sorts its results, which fixes the shard order
+    if (glob(pattern.c_str(), 0, nullptr, &matches) == 0)
+    {
+        for (size_t i = 0; i < matches.gl_pathc; ++i)
+        {
+            files.emplace_back(matches.gl_pathv[i]);
+        }
+    }
+    globfree(&matches);
+    return files;
+}
+
+template <typename MergeFn>
+bool ingestCsvFiles(const std::vector<std::string> &files, unsigned threads, MergeFn &&merge,
+                    IngestStats &stats, SongDeduplicator *dedup = nullptr, size_t chunkBytes = 4 << 20,
+                    size_t maxPendingChunks = 0)
+{
+/**
+ * @brief Loads every file through the I/O -> parse -> merge pipeline
+ *
+ * @param files - CSV shards, merged in this order
+ * @param threads - number of parse workers
+ * @param merge - merge(std::vector<Song> &&rows) is called on this thread once per chunk,
+ *                in file order and chunk order
+ * @param stats - receives per-stage counters and timings
+ * @param dedup - if set, only the copy of each (title, artist) its policy prefers is merged
+ * @param chunkBytes - target size of a parse task; chunks always end on a row boundary
+ * @param maxPendingChunks - chunks that may be queued or parsed but not yet merged before the
+ *                         I/O stage waits for the merge (0 = 4 per thread); a deduplicating
+ *                         run holds every chunk until parsing ends and is not limited
+ * @return false if a file could not be mapped (files before it are still merged)
+ */
+    auto wallStart = std::chrono::steady_clock::now();
+
+    struct Chunk
+    {
+        std::vector<Song> rows;
+        std::vector<const SongDeduplicator::Entry *> entries;   // per row, with a deduplicator
+        size_t skipped = 0;
+        bool done = false;
+    };
+
+    std::vector<std::unique_ptr<MappedFile>> mapped;
+    std::deque<CsvColumnMap> fileColumns;   // header layout per file, for chunks past the header
+    std::deque<Chunk> chunks;       // deque keeps references stable while the I/O stage appends
+    std::mutex chunkMutex;
+    std::condition_variable chunkReady;
+    std::condition_variable chunkMerged;
+    bool ioFinished = false;
+    bool ioFailed = false;
+    size_t parsedChunks = 0;
+    size_t mergedChunks = 0;
+
+    WorkStealingPool pool(threads);
+    if (maxPendingChunks == 0)
+    {
+        maxPendingChunks = 4 * pool.threads();
+    }
+
+    // Stage 1: map, prefault and split each file, submitting parse tasks as chunks appear
+    std::thread io([&] {
+        auto ioStart = std::chrono::steady_clock::now();
+        const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        CsvStructuralIndex rowIndex;
+        for (const std::string &path : files)
+        {
+            auto file = std::make_unique<MappedFile>();
+            if (!file->open(path))
+            {
+                std::lock_guard<std::mutex> lock(chunkMutex);
+                ioFailed = true;
+                break;
+            }
+            std::string_view text = file->view();
+            stats.bytes += text.size();
+            ++stats.files;
+            std::vector<std::string_view> header;
+            splitCsvFields(text.substr(0, text.find('\n')), header);
+            fileColumns.emplace_back();
+            fileColumns.back().resolve(header.data(), static_cast<int>(header.size()));
+            CsvColumnMap *columns = &fileColumns.back();
+
+            bool first = true;
+            while (!text.empty())
+            {
+                // text always starts at a row, so the quote state of the scan is known
+                size_t cut = chunkBytes < text.size() ? rowIndex.rowBoundaryAfter(text, chunkBytes) : text.size();
+                std::string_view part = text.substr(0, cut);
+                text.remove_prefix(cut);
+
+                // Touch every page so the parse workers never block on the disk
+                volatile char sink = 0;
+                for (size_t off = 0; off < part.size(); off += page)
+                {
+                    sink = sink + part[off];
+                }
+
+                Chunk *chunk;
+                uint64_t chunkIndex;
+                {
+                    std::unique_lock<std::mutex> lock(chunkMutex);
+                    if (dedup == nullptr)
+                    {
+                        chunkMerged.wait(lock, [&] { return chunks.size() - mergedChunks < maxPendingChunks; });
+                    }
+                    chunkIndex = chunks.size();
+                    chunks.emplace_back();
+                    chunk = &chunks.back();
+                }
+                pool.submit([&, chunk, chunkIndex, part, first, columns] {
+                    std::vector<Song> rows;
+                    size_t skipped = 0;
+                    // the first chunk reads its own header; the others share the I/O stage's map
+                    forEachSongRow(part, [&rows](const SongRowView &row) {
+                        rows.push_back(toSong(row));
+                    }, &skipped, first, first ? nullptr : columns);
+                    std::vector<const SongDeduplicator::Entry *> entries;
+                    if (dedup != nullptr)
+                    {
+                        // seq orders rows by (chunk, row), which is file order
+                        entries.reserve(rows.size());
+                        for (size_t i = 0; i < rows.size(); ++i)
+                        {
+                            entries.push_back(dedup->offer(rows[i], chunkIndex << 32 | i));
+                        }
+                    }
+                    {
+                        std::lock_guard<std::mutex> lock(chunkMutex);
+                        chunk->rows = std::move(rows);
+                        chunk->entries = std::move(entries);
+                        chunk->skipped = skipped;
+                        chunk->done = true;
+                        ++parsedChunks;
+                    }
+                    chunkReady.notify_all();
+                });
+                first = false;
+            }
+            mapped.push_back(std::move(file));
+        }
+        stats.ioSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - ioStart).count();
+        {
+            std::lock_guard<std::mutex> lock(chunkMutex);
+            ioFinished = true;
+        }
+        chunkReady.notify_all();
+    });
+
+    // Stage 3: merge chunks strictly in submission order as soon as each one is parsed. A later
+    // row can still beat an earlier copy, so deduplication holds the merge until parsing is over.
+    if (dedup != nullptr)
+    {
+        std::unique_lock<std::mutex> lock(chunkMutex);
+        chunkReady.wait(lock, [&] { return ioFinished && parsedChunks == chunks.size(); });
+    }
+    for (size_t next = 0;; ++next)
+    {
+        std::vector<Song> rows;
+        std::vector<const SongDeduplicator::Entry *> entries;
+        {
+            std::unique_lock<std::mutex> lock(chunkMutex);
+            chunkReady.wait(lock, [&] {
+                return (next < chunks.size() && chunks[next].done) || (ioFinished && next >= chunks.size());
+            });
+            if (next >= chunks.size())
+            {
+                break;
+            }
+            rows = std::move(chunks[next].rows);
+            entries = std::move(chunks[next].entries);
+            stats.skipped += chunks[next].skipped;
+            mergedChunks = next + 1;
+        }
+        chunkMerged.notify_one();
+        auto mergeStart = std::chrono::steady_clock::now();
+        if (dedup != nullptr)
+        {
+            stats.dedup.rows += rows.size();
+            size_t kept = 0;
+            for (size_t i = 0; i < rows.size(); ++i)
+            {
+                if (SongDeduplicator::keeps(entries[i], static_cast<uint64_t>(next) << 32 | i))
+                {
+                    if (kept != i)
+                    {
+                        rows[kept] = std::move(rows[i]);
+                    }
+                    ++kept;
+                }
+                else
+                {
+                    ++stats.dedup.duplicates;
+                    stats.dedup.bytesSaved += SongDeduplicator::songBytes(rows[i]);
+                }
+            }
+            rows.resize(kept);
+        }
+        stats.rows += rows.size();
+        merge(std::move(rows));
+        stats.mergeSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - mergeStart).count();
+    }
+
+    io.join();
+    stats.chunks = chunks.size();
+    stats.threads = static_cast<unsigned>(pool.threads());
+    stats.steals = pool.steals();
+    stats.parseSeconds = pool.busySeconds();
+    stats.wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+    return !ioFailed;
+}
+
+inline void printIngestStats(const IngestStats &stats, std::ostream &out)
+{
+/**
+ * @brief Prints per-stage throughput for an ingestion run
+ *
+ * @param stats - counters from ingestCsvFiles
+ * @param out - stream to print to
+ */
+    const double mb = stats.bytes / 1e6;
+    out << "Ingested " << stats.rows << " songs from " << stats.files << " files (" << stats.chunks
+        << " chunks, " << stats.skipped << " skipped) on " << stats.threads << " threads in "
+        << stats.wallSeconds * 1000 << " ms" << std::endl
+        << "\tI/O:   " << stats.ioSeconds * 1000 << " ms, "
+        << (stats.ioSeconds > 0 ? mb / stats.ioSeconds : 0) << " MB/s" << std::endl
+        << "\tparse: " << stats.parseSeconds * 1000 << " ms busy, "
+        << static_cast<long long>(stats.parseSeconds > 0 ? stats.rows / stats.parseSeconds : 0)
+        << " rows/sec per thread, " << stats.steals << " steals" << std::endl
+        << "\tmerge: " << stats.mergeSeconds * 1000 << " ms, "
+        << static_cast<long long>(stats.mergeSeconds > 0 ? stats.rows / stats.mergeSeconds : 0)
+        << " rows/sec" << std::endl;
+    if (stats.dedup.rows > 0)
+    {
+        out << "\tdedup: " << stats.dedup.duplicates << " duplicates collapsed, "
+            << stats.dedup.bytesSaved << " bytes saved" << std::endl;
+    }
+}
+
+#endif // PLAYLIST_INGEST_H
@@ -0,0 +1,585 @@
+/**
+ * @file ivf_pq.h
+ * @brief Approximate nearest-neighbour index (IVF + product quantization) for huge catalogs.
+ * Rows are clustered with k-means into inverted lists around coarse centroids. Within a list
+ * each row is stored as a product-quantized code of its residual (row - centroid): the 11
+ * features are split into a few subspaces and each subspace is replaced by the index of the
+ * nearest of up to 256 sub-centroids, so a row costs one byte per subspace. A query only scans
+ * the lists of its `probes` nearest centroids, estimating distances with one table lookup per
+ * subspace, and re-ranks the best candidates with exact integer distances. More probes and a
+ * larger re-rank pool trade latency for recall; measureIvfRecall reports recall@K against the
+ * exact ranking so settings can be picked safely.
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef PLAYLIST_IVF_PQ_H
+#define PLAYLIST_IVF_PQ_H
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <numeric>
+#include <ostream>
+#include <vector>
+
+#include "song.h"
+#include "song_table.h"
+#include "score_kernels.h"
+#include "split_mix64.h"
+#include "top_k.h"
+#include "kd_tree.h"
+
+/**
+ * @brief Build and query settings of an IvfPqIndex
+ *
+ */
+struct IvfPqConfig
+{
+    size_t lists = 0;           // inverted lists (0 = about sqrt(rows))
+    size_t probes = 8;          // lists scanned per query
+    int subspaces = 4;          // PQ subspaces, 1 to 11; one code byte each
+    size_t rerank = 8;          // exact re-rank pool, as a multiple of K
+    int iterations = 12;        // k-means iterations for both quantizers
+    size_t trainRows = 65536;   // rows sampled to train the quantizers
+    uint64_t seed = 1;          // sampling and initialization seed
+};
+
+/**
+ * @brief Centroids laid out for fast nearest-centroid search: stored feature-major in blocks of
+ * eight so the inner loop is a fixed-width multiply-add the compiler vectorizes. Ranks by
+ * |c|^2 - 2 p.c, which orders centroids like the squared distance without the |p|^2 term.
+ *
+ */
+class CentroidTable
+{
+public:
+    CentroidTable(const std::vector<float> &centroids, int dims)
+        : dims_(dims), count_(centroids.size() / dims), padded_((count_ + 7) / 8 * 8),
+          columns_(dims * padded_, 0.0f), norm_(padded_, std::numeric_limits<float>::max())
+    {
+        for (size_t c = 0; c < count_; ++c)
+        {
+            norm_[c] = 0;
+            for (int d = 0; d < dims; ++d)
+            {
+                float v = centroids[c * dims + d];
+                columns_[d * padded_ + c] = v;
+                norm_[c] += v * v;
+            }
+        }
+    }
+
+    size_t nearest(const float *point) const
+    {
+    /**
+     * @brief Index of the centroid closest to point
+     *
+     * @param point - dims floats
+     */
+        size_t best = 0;
+        float bestScore = std::numeric_limits<float>::max();
+        for (size_t c0 = 0; c0 < padded_; c0 += 8)
+        {
+            float acc[8];
+            for (int j = 0; j < 8; ++j)
+            {
+                acc[j] = norm_[c0 + j];
+            }
+            for (int d = 0; d < dims_; ++d)
+            {
+                const float w = -2 * point[d];
+                const float *column = &columns_[d * padded_ + c0];
+                for (int j = 0; j < 8; ++j)
+                {
+                    acc[j] += w * column[j];
+                }
+            }
+            for (int j = 0; j < 8; ++j)
+            {
+                if (acc[j] < bestScore)
+                {
+                    bestScore = acc[j];
+                    best = c0 + j;
+                }
+            }
+        }
+        return best;
+    }
+
+private:
+    int dims_;
+    size_t count_;
+    size_t padded_;                 // count_ rounded up to a multiple of 8
+    std::vector<float> columns_;    // dims_ rows of padded_ centroid coordinates
+    std::vector<float> norm_;       // |c|^2 per centroid; padding slots never win
+};
+
+inline void trainKMeans(const std::vector<float> &points, int dims, size_t k, int iterations,
+                        SplitMix64 &rng, std::vector<float> &centroids)
+{
+/**
+ * @brief Lloyd's k-means. Centroids start at distinct random points; a cluster that empties is
+ * re-seeded at a random point.
+ *
+ * @param points - row-major points, dims floats each
+ * @param dims - floats per point
+ * @param k - clusters wanted (at most the number of points)
+ * @param iterations - Lloyd iterations
+ * @param rng - random source
+ * @param centroids - receives k row-major centroids
+ */
+    const size_t n = points.size() / dims;
+    k = std::min(k, n);
+    centroids.assign(k * dims, 0);
+    std::vector<size_t> pick(n);
+    std::iota(pick.begin(), pick.end(), 0);
+    for (size_t c = 0; c < k; ++c)
+    {
+        std::swap(pick[c], pick[c + rng.below(n - c)]);
+        std::copy_n(&points[pick[c] * dims], dims, &centroids[c * dims]);
+    }
+
+    std::vector<double> sums(k * dims);
+    std::vector<size_t> counts(k);
+    for (int iteration = 0; iteration < iterations; ++iteration)
+    {
+        std::fill(sums.begin(), sums.end(), 0.0);
+        std::fill(counts.begin(), counts.end(), 0);
+        CentroidTable lookup(centroids, dims);
+        for (size_t i = 0; i < n; ++i)
+        {
+            const float *p = &points[i * dims];
+            size_t best = lookup.nearest(p);
+            ++counts[best];
+            for (int d = 0; d < dims; ++d)
+            {
+                sums[best * dims + d] += p[d];
+            }
+        }
+        for (size_t c = 0; c < k; ++c)
+        {
+            for (int d = 0; d < dims; ++d)
+            {
+                centroids[c * dims + d] = counts[c] > 0
+                    ? static_cast<float>(sums[c * dims + d] / counts[c])
+                    : points[rng.below(n) * dims + d];
+            }
+        }
+    }
+}
+
+/**
+ * @brief Counters for one approximate query
+ *
+ */
+struct IvfSearchStats
+{
+    size_t listsScanned = 0;
+    size_t codesScanned = 0;    // rows whose distance was estimated from their code
+    size_t reranked = 0;        // rows whose exact distance was computed
+};
+
+class IvfPqIndex
+{
+public:
+    void build(const SongTable &table, const IvfPqConfig &config)
+    {
+    /**
+     * @brief Trains both quantizers on a sample of the table and encodes every row. The table
+     * must outlive the index.
+     *
+     * @param table - catalog to index
+     * @param config - build and default query settings
+     */
+        table_ = &table;
+        config_ = config;
+        const size_t n = table.size();
+        config_.subspaces = std::max(1, std::min(config_.subspaces, SCORE_FEATURES));
+        if (config_.lists == 0)
+        {
+            config_.lists = std::max<size_t>(1, static_cast<size_t>(std::sqrt(static_cast<double>(n))));
+        }
+        listStart_.assign(1, 0);
+        rows_.clear();
+        codes_.clear();
+        if (n == 0)
+        {
+            return;
+        }
+
+        std::vector<float> features(n * SCORE_FEATURES);
+        for (size_t i = 0; i < n; ++i)
+        {
+            ScoreSetpoint row(table, i);
+            std::copy_n(row.value, SCORE_FEATURES, &features[i * SCORE_FEATURES]);
+        }
+
+        // train the coarse quantizer on a sample, then assign every row to a list
+        SplitMix64 rng{config_.seed};
+        std::vector<float> sample;
+        sampleRows(features, SCORE_FEATURES, n, rng, sample);
+        trainKMeans(sample, SCORE_FEATURES, config_.lists, config_.iterations, rng, coarse_);
+        config_.lists = coarse_.size() / SCORE_FEATURES;
+        std::vector<uint32_t> list(n);
+        std::vector<float> residuals(n * SCORE_FEATURES);
+        CentroidTable coarseLookup(coarse_, SCORE_FEATURES);
+        for (size_t i = 0; i < n; ++i)
+        {
+            const float *p = &features[i * SCORE_FEATURES];
+            list[i] = static_cast<uint32_t>(coarseLookup.nearest(p));
+            const float *centroid = &coarse_[list[i] * SCORE_FEATURES];
+            for (int d = 0; d < SCORE_FEATURES; ++d)
+            {
+                residuals[i * SCORE_FEATURES + d] = p[d] - centroid[d];
+            }
+        }
+
+        // split the features into subspaces of roughly equal residual variance, then train one
+        // codebook of up to 256 entries per subspace
+        assignSubspaces(residuals, n);
+        codebooks_.assign(config_.subspaces, std::vector<float>());
+        for (int m = 0; m < config_.subspaces; ++m)
+        {
+            std::vector<float> sub;
+            project(residuals, n, m, sub);
+            std::vector<float> subSample;
+            sampleRows(sub, dimCount(m), n, rng, subSample);
+            trainKMeans(subSample, dimCount(m), 256, config_.iterations, rng, codebooks_[m]);
+        }
+
+        // counting sort rows into their lists and store each row's codes in list order
+        listStart_.assign(config_.lists + 1, 0);
+        for (uint32_t l : list)
+        {
+            ++listStart_[l + 1];
+        }
+        std::partial_sum(listStart_.begin(), listStart_.end(), listStart_.begin());
+        std::vector<size_t> next(listStart_.begin(), listStart_.end() - 1);
+        rows_.resize(n);
+        codes_.resize(n * config_.subspaces);
+        std::vector<CentroidTable> codebookLookup;
+        for (int m = 0; m < config_.subspaces; ++m)
+        {
+            codebookLookup.emplace_back(codebooks_[m], dimCount(m));
+        }
+        float sub[SCORE_FEATURES];
+        for (size_t i = 0; i < n; ++i)
+        {
+            size_t pos = next[list[i]]++;
+            rows_[pos] = static_cast<uint32_t>(i);
+            for (int m = 0; m < config_.subspaces; ++m)
+            {
+                for (int j = 0; j < dimCount(m); ++j)
+                {
+                    sub[j] = residuals[i * SCORE_FEATURES + dims_[m][j]];
+                }
+                codes_[pos * config_.subspaces + m] = static_cast<uint8_t>(codebookLookup[m].nearest(sub));
+            }
+        }
+    }
+
+    const IvfPqConfig &config() const { return config_; }
+    size_t lists() const { return config_.lists; }
+
+    size_t memoryBytes() const
+    {
+    /**
+     * @brief Bytes held by the codes, row ids, list offsets and both quantizers
+     */
+        size_t bytes = codes_.size() + rows_.size() * sizeof(uint32_t) + listStart_.size() * sizeof(size_t)
+            + coarse_.size() * sizeof(float);
+        for (const std::vector<float> &codebook : codebooks_)
+        {
+            bytes += codebook.size() * sizeof(float);
+        }
+        return bytes;
+    }
+
+    void search(const ScoreSetpoint &sp, size_t k, std::vector<Neighbour> &result, size_t probes = 0,
+                IvfSearchStats *stats = nullptr) const
+    {
+    /**
+     * @brief Approximate k nearest rows. Candidates come from the probed lists by PQ distance;
+     * the best k * rerank of them are re-ranked with exact distances, so every returned
+     * distance is exact and ties are broken by artist as in the exact ranking.
+     *
+     * @param sp - setpoint features
+     * @param k - neighbours wanted
+     * @param result - receives at most k neighbours, best first
+     * @param probes - lists to scan (0 = the configured default)
+     * @param stats - optional counters for the query
+     */
+        result.clear();
+        if (rows_.empty() || k == 0)
+        {
+            return;
+        }
+        probes = std::min(probes > 0 ? probes : config_.probes, config_.lists);
+        const int subspaces = config_.subspaces;
+        float query[SCORE_FEATURES];
+        std::copy_n(sp.value, SCORE_FEATURES, query);
+
+        // nearest coarse centroids
+        std::vector<std::pair<float, uint32_t>> centroidDist(config_.lists);
+        for (size_t l = 0; l < config_.lists; ++l)
+        {
+            const float *centroid = &coarse_[l * SCORE_FEATURES];
+            float dist = 0;
+            for (int d = 0; d < SCORE_FEATURES; ++d)
+            {
+                float diff = query[d] - centroid[d];
+                dist += diff * diff;
+            }
+            centroidDist[l] = {dist, static_cast<uint32_t>(l)};
+        }
+        std::partial_sort(centroidDist.begin(), centroidDist.begin() + probes, centroidDist.end());
+
+        // scan the probed lists keeping the best candidates by estimated distance
+        const size_t pool = std::max(k, k * std::max<size_t>(1, config_.rerank));
+        std::vector<std::pair<float, uint32_t>> candidates;     // max-heap on estimate
+        candidates.reserve(pool);
+        std::vector<float> table(subspaces * 256);
+        float residual[SCORE_FEATURES];
+        for (size_t p = 0; p < probes; ++p)
+        {
+            uint32_t l = centroidDist[p].second;
+            const float *centroid = &coarse_[l * SCORE_FEATURES];
+            for (int d = 0; d < SCORE_FEATURES; ++d)
+            {
+                residual[d] = query[d] - centroid[d];
+            }
+            buildDistanceTable(residual, table);
+
+            for (size_t pos = listStart_[l]; pos < listStart_[l + 1]; ++pos)
+            {
+                const uint8_t *code = &codes_[pos * subspaces];
+                float estimate = 0;
+                for (int m = 0; m < subspaces; ++m)
+                {
+                    estimate += table[m * 256 + code[m]];
+                }
+                if (candidates.size() < pool)
+                {
+                    candidates.emplace_back(estimate, rows_[pos]);
+                    std::push_heap(candidates.begin(), candidates.end());
+                }
+                else if (estimate < candidates.front().first)
+                {
+                    std::pop_heap(candidates.begin(), candidates.end());
+                    candidates.back() = {estimate, rows_[pos]};
+                    std::push_heap(candidates.begin(), candidates.end());
+                }
+            }
+            if (stats != nullptr)
+            {
+                ++stats->listsScanned;
+                stats->codesScanned += listStart_[l + 1] - listStart_[l];
+            }
+        }
+
+        // exact re-rank
+        const SongText &text = table_->text;
+        result.reserve(candidates.size());
+        for (const std::pair<float, uint32_t> &candidate : candidates)
+        {
+            result.push_back(Neighbour{squaredDistanceRow(*table_, sp, candidate.second), candidate.second});
+        }
+        auto closer = [&text](const Neighbour &a, const Neighbour &b) {
+            if (a.dist2 != b.dist2)
+            {
+                return a.dist2 < b.dist2;
+            }
+            return text.artistLess(a.row, b.row);
+        };
+        size_t keep = std::min(k, result.size());
+        std::partial_sort(result.begin(), result.begin() + keep, result.end(), closer);
+        result.resize(keep);
+        if (stats != nullptr)
+        {
+            stats->reranked += candidates.size();
+        }
+    }
+
+private:
+    int dimCount(int m) const { return static_cast<int>(dims_[m].size()); }
+
+    void sampleRows(const std::vector<float> &points, int dims, size_t n, SplitMix64 &rng,
+                    std::vector<float> &sample) const
+    {
+    /**
+     * @brief Copies up to config_.trainRows random points (all of them if there are fewer)
+     */
+        if (n <= config_.trainRows)
+        {
+            sample = points;
+            return;
+        }
+        sample.resize(config_.trainRows * dims);
+        for (size_t s = 0; s < config_.trainRows; ++s)
+        {
+            std::copy_n(&points[rng.below(n) * dims], dims, &sample[s * dims]);
+        }
+    }
+
+    void assignSubspaces(const std::vector<float> &residuals, size_t n)
+    {
+    /**
+     * @brief Deals features out to subspaces, largest residual variance first, each to the
+     * subspace with the least variance so far that still has room. Feature scales differ by
+     * orders of magnitude (dur against dB), so a plain contiguous split would spend most
+     * codebooks on near-constant residuals.
+     */
+        double variance[SCORE_FEATURES] = {};
+        for (size_t i = 0; i < n; ++i)
+        {
+            for (int d = 0; d < SCORE_FEATURES; ++d)
+            {
+                double r = residuals[i * SCORE_FEATURES + d];
+                variance[d] += r * r;
+            }
+        }
+        int byVariance[SCORE_FEATURES];
+        std::iota(byVariance, byVariance + SCORE_FEATURES, 0);
+        std::sort(byVariance, byVariance + SCORE_FEATURES, [&](int a, int b) { return variance[a] > variance[b]; });
+
+        const size_t room = (SCORE_FEATURES + config_.subspaces - 1) / config_.subspaces;
+        dims_.assign(config_.subspaces, std::vector<int>());
+        std::vector<double> load(config_.subspaces, 0.0);
+        for (int d : byVariance)
+        {
+            int target = -1;
+            for (int m = 0; m < config_.subspaces; ++m)
+            {
+                if (dims_[m].size() < room && (target < 0 || load[m] < load[target]))
+                {
+                    target = m;
+                }
+            }
+            dims_[target].push_back(d);
+            load[target] += variance[d];
+        }
+        // a subspace can only be empty when there are more subspaces than features
+        dims_.erase(std::remove_if(dims_.begin(), dims_.end(), [](const std::vector<int> &dims) {
+            return dims.empty();
+        }), dims_.end());
+        config_.subspaces = static_cast<int>(dims_.size());
+    }
+
+    void project(const std::vector<float> &residuals, size_t n, int m, std::vector<float> &sub) const
+    {
+        sub.resize(n * dimCount(m));
+        for (size_t i = 0; i < n; ++i)
+        {
+            for (int j = 0; j < dimCount(m); ++j)
+            {
+                sub[i * dimCount(m) + j] = residuals[i * SCORE_FEATURES + dims_[m][j]];
+            }
+        }
+    }
+
+    void buildDistanceTable(const float *residual, std::vector<float> &table) const
+    {
+    /**
+     * @brief table[m * 256 + c] = squared distance from the query residual to code c of
+     * subspace m, so a row's estimate is one lookup per subspace
+     */
+        for (int m = 0; m < config_.subspaces; ++m)
+        {
+            const std::vector<float> &codebook = codebooks_[m];
+            const int dims = dimCount(m);
+            const size_t codes = codebook.size() / dims;
+            for (size_t c = 0; c < 256; ++c)
+            {
+                float dist = std::numeric_limits<float>::max();
+                if (c < codes)
+                {
+                    dist = 0;
+                    for (int j = 0; j < dims; ++j)
+                    {
+                        float diff = residual[dims_[m][j]] - codebook[c * dims + j];
+                        dist += diff * diff;
+                    }
+                }
+                table[m * 256 + c] = dist;
+            }
+        }
+    }
+
+    const SongTable *table_ = nullptr;
+    IvfPqConfig config_;
+    std::vector<float> coarse_;                 // list centroids, row-major
+    std::vector<std::vector<int>> dims_;        // features of each subspace
+    std::vector<std::vector<float>> codebooks_; // per subspace: up to 256 row-major sub-centroids
+    std::vector<size_t> listStart_;             // first position of each list; one past the end last
+    std::vector<uint32_t> rows_;                // SongTable row per position, grouped by list
+    std::vector<uint8_t> codes_;                // subspaces codes per position
+};
+
+inline void measureIvfRecall(const SongTable &table, const IvfPqIndex &index, size_t queries, size_t k,
+                             std::ostream &out)
+{
+/**
+ * @brief Prints recall@K and mean query time of the index for a sweep of probe counts,
+ * against the exact ranking (the batched kernel plus topKRows) as reference. Query setpoints
+ * are rows spread evenly through the table.
+ *
+ * @param table - catalog the index was built over
+ * @param index - index to measure
+ * @param queries - setpoints to average over
+ * @param k - playlist length the recall is measured at
+ * @param out - where the report goes
+ */
+    if (table.size() == 0 || queries == 0 || k == 0)
+    {
+        return;
+    }
+    queries = std::min(queries, table.size());
+    BatchScorer scorer(table);
+    std::vector<std::vector<uint32_t>> exact(queries);
+    std::vector<double> dist2(table.size());
+    double exactSeconds = 0;
+    for (size_t q = 0; q < queries; ++q)
+    {
+        uint32_t row = static_cast<uint32_t>(q * table.size() / queries);
+        auto start = std::chrono::steady_clock::now();
+        scorer.scoreBlock(ScoreSetpoint(table, row), 0, table.size(), dist2.data());
+        topKRows(table, dist2, k, exact[q]);
+        exactSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::sort(exact[q].begin(), exact[q].end());
+    }
+    out << "recall@" << k << " over " << queries << " queries (exact: " << exactSeconds * 1000 / queries
+        << " ms/query)" << std::endl;
+
+    std::vector<Neighbour> result;
+    for (size_t probes = 1; ; probes *= 2)
+    {
+        probes = std::min(probes, index.lists());
+        double hits = 0;
+        IvfSearchStats stats;
+        auto start = std::chrono::steady_clock::now();
+        for (size_t q = 0; q < queries; ++q)
+        {
+            uint32_t row = static_cast<uint32_t>(q * table.size() / queries);
+            index.search(ScoreSetpoint(table, row), k, result, probes, &stats);
+            for (const Neighbour &neighbour : result)
+            {
+                hits += std::binary_search(exact[q].begin(), exact[q].end(), neighbour.row) ? 1 : 0;
+            }
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        out << "  probes " << probes << ": recall " << hits / (queries * std::min(k, table.size()))
+            << ", " << seconds * 1000 / queries << " ms/query, " << stats.codesScanned / queries
+            << " codes scanned/query" << std::endl;
+        if (probes == index.lists() || probes >= 256)
+        {
+            break;
+        }
+    }
+}
+
+#endif // PLAYLIST_IVF_PQ_H
@@ -0,0 +1,416 @@
+/**
+ * @file kd_tree.h
+ * @brief Exact k-nearest-neighbour index over the 11 dj_score features.
+ * The tree is built once over a SongTable: each node splits its rows at the median of the
+ * feature with the widest spread and keeps the bounding box of its rows, down to leaves of
+ * LEAF_SIZE rows stored contiguously. A query descends toward the setpoint first and skips any
+ * subtree whose box is strictly farther than the current K-th best, so equal-distance rows are
+ * still compared by artist and the result is exactly topKRows' ranking.
+ * Rows can be removed after the build: every node counts its live rows and its box shrinks to
+ * the rows that are left, so repeated nearest-then-remove walks keep pruning as well as a
+ * freshly built tree. A query can also be limited to rows whose value of one feature lies in
+ * a window.
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef PLAYLIST_KD_TREE_H
+#define PLAYLIST_KD_TREE_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "song.h"
+#include "song_table.h"
+#include "score_kernels.h"
+
+/**
+ * @brief One candidate of a nearest-neighbour query
+ *
+ */
+struct Neighbour
+{
+    int64_t dist2;  // squared dj_score distance
+    uint32_t row;   // row in the SongTable
+};
+
+/**
+ * @brief Restricts a query to rows with lo <= feature value <= hi
+ *
+ */
+struct FeatureWindow
+{
+    int feature;    // kernel column order (see ScoreSetpoint)
+    int lo;
+    int hi;
+};
+
+class KdTree
+{
+public:
+    // Rows per leaf; small enough to stay in L1, large enough to amortize the box tests
+    static constexpr size_t LEAF_SIZE = 16;
+
+    void build(const SongTable &table)
+    {
+    /**
+     * @brief Builds the tree over every row of table. The table must outlive the tree.
+     *
+     * @param table - catalog to index
+     */
+        table_ = &table;
+        const size_t n = table.size();
+        rows_.resize(n);
+        points_.resize(n * SCORE_FEATURES);
+        for (size_t i = 0; i < n; ++i)
+        {
+            rows_[i] = static_cast<uint32_t>(i);
+            int32_t *p = &points_[i * SCORE_FEATURES];
+            forEachFeature([&](auto k) { p[k] = table.column<k>()[i]; });
+        }
+        nodes_.clear();
+        boxes_.clear();
+        if (n > 0)
+        {
+            std::vector<uint32_t> order(n);
+            for (size_t i = 0; i < n; ++i)
+            {
+                order[i] = static_cast<uint32_t>(i);
+            }
+            buildNode(order, 0, n);
+
+            // Store points and row ids in tree order so every leaf is contiguous
+            std::vector<int32_t> sorted(points_.size());
+            std::vector<uint32_t> sortedRows(n);
+            for (size_t pos = 0; pos < n; ++pos)
+            {
+                std::copy_n(&points_[static_cast<size_t>(order[pos]) * SCORE_FEATURES], SCORE_FEATURES,
+                            &sorted[pos * SCORE_FEATURES]);
+                sortedRows[pos] = rows_[order[pos]];
+            }
+            points_.swap(sorted);
+            rows_.swap(sortedRows);
+        }
+        position_.resize(n);
+        for (size_t pos = 0; pos < n; ++pos)
+        {
+            position_[rows_[pos]] = static_cast<uint32_t>(pos);
+        }
+        alive_.assign(n, 1);
+        live_.resize(nodes_.size());
+        for (size_t id = 0; id < nodes_.size(); ++id)
+        {
+            live_[id] = nodes_[id].end - nodes_[id].begin;
+        }
+    }
+
+    bool remove(uint32_t row)
+    {
+    /**
+     * @brief Removes a row from all later queries
+     *
+     * @param row - row in the SongTable
+     * @return false if the row was already removed
+     */
+        uint32_t pos = position_[row];
+        if (!alive_[pos])
+        {
+            return false;
+        }
+        alive_[pos] = 0;
+        path_.clear();
+        int32_t id = 0;
+        while (id >= 0)
+        {
+            --live_[id];
+            path_.push_back(id);
+            const Node &node = nodes_[id];
+            id = node.left >= 0 && pos >= nodes_[node.right].begin ? node.right : node.left;
+        }
+
+        // shrink the leaf's box to its live rows, then every ancestor's to its live children
+        int32_t leaf = path_.back();
+        int32_t *lo = &boxes_[static_cast<size_t>(leaf) * 2 * SCORE_FEATURES];
+        int32_t *hi = lo + SCORE_FEATURES;
+        std::fill(lo, hi, INT32_MAX);
+        std::fill(hi, hi + SCORE_FEATURES, INT32_MIN);
+        for (uint32_t live = nodes_[leaf].begin; live < nodes_[leaf].end; ++live)
+        {
+            if (alive_[live])
+            {
+                growBox(leaf, &points_[static_cast<size_t>(live) * SCORE_FEATURES]);
+            }
+        }
+        for (size_t i = path_.size() - 1; i-- > 0;)
+        {
+            int32_t parent = path_[i];
+            lo = &boxes_[static_cast<size_t>(parent) * 2 * SCORE_FEATURES];
+            std::fill(lo, lo + SCORE_FEATURES, INT32_MAX);
+            std::fill(lo + SCORE_FEATURES, lo + 2 * SCORE_FEATURES, INT32_MIN);
+            for (int32_t child : {nodes_[parent].left, nodes_[parent].right})
+            {
+                if (live_[child] > 0)
+                {
+                    growBox(parent, &boxes_[static_cast<size_t>(child) * 2 * SCORE_FEATURES]);
+                    growBox(parent, &boxes_[static_cast<size_t>(child) * 2 * SCORE_FEATURES + SCORE_FEATURES]);
+                }
+            }
+        }
+        return true;
+    }
+
+    // Rows not removed yet
+    size_t liveCount() const { return live_.empty() ? 0 : live_[0]; }
+
+    void nearest(const Song &setpointSong, size_t k, std::vector<Neighbour> &result,
+                 size_t *nodesVisited = nullptr, const FeatureWindow *window = nullptr) const
+    {
+        // Same query with the setpoint given as a Song
+        nearest(ScoreSetpoint(setpointSong), k, result, nodesVisited, window);
+    }
+
+    void nearest(const ScoreSetpoint &sp, size_t k, std::vector<Neighbour> &result,
+                 size_t *nodesVisited = nullptr, const FeatureWindow *window = nullptr) const
+    {
+    /**
+     * @brief The k live rows closest to the setpoint, ordered by distance then artist
+     *
+     * @param sp - setpoint features
+     * @param k - number of neighbours
+     * @param result - receives min(k, matching rows) neighbours, best first
+     * @param nodesVisited - optional count of tree nodes the query touched
+     * @param window - if not null, only rows inside this feature window are considered
+     */
+        result.clear();
+        if (nodes_.empty() || k == 0)
+        {
+            return;
+        }
+        Search search{sp, std::min(k, rows_.size()), result, 0, window};
+        result.reserve(search.k);
+        if (!outsideWindow(0, window))
+        {
+            visit(0, search);
+        }
+        if (nodesVisited != nullptr)
+        {
+            *nodesVisited = search.visited;
+        }
+        std::sort_heap(result.begin(), result.end(), Closer{table_});
+    }
+
+private:
+    struct Node
+    {
+        uint32_t begin;
+        uint32_t end;
+        int32_t left;   // child node ids, -1 for leaves
+        int32_t right;
+    };
+
+    // Orders neighbours by squared distance, then artist, like sortRowsBySquaredDistance
+    struct Closer
+    {
+        const SongTable *table;
+
+        bool operator()(const Neighbour &a, const Neighbour &b) const
+        {
+            if (a.dist2 != b.dist2)
+            {
+                return a.dist2 < b.dist2;
+            }
+            return table->text.artistLess(a.row, b.row);
+        }
+    };
+
+    struct Search
+    {
+        const ScoreSetpoint &sp;
+        size_t k;
+        std::vector<Neighbour> &heap;   // max-heap under Closer: front is the current K-th best
+        size_t visited;
+        const FeatureWindow *window;
+    };
+
+    int32_t buildNode(std::vector<uint32_t> &order, size_t begin, size_t end)
+    {
+        int32_t id = static_cast<int32_t>(nodes_.size());
+        nodes_.push_back(Node{static_cast<uint32_t>(begin), static_cast<uint32_t>(end), -1, -1});
+        boxes_.resize(boxes_.size() + 2 * SCORE_FEATURES);
+        int32_t *lo = &boxes_[static_cast<size_t>(id) * 2 * SCORE_FEATURES];
+        int32_t *hi = lo + SCORE_FEATURES;
+        for (int d = 0; d < SCORE_FEATURES; ++d)
+        {
+            lo[d] = INT32_MAX;
+            hi[d] = INT32_MIN;
+        }
+        for (size_t pos = begin; pos < end; ++pos)
+        {
+            const int32_t *p = &points_[static_cast<size_t>(order[pos]) * SCORE_FEATURES];
+            for (int d = 0; d < SCORE_FEATURES; ++d)
+            {
+                lo[d] = std::min(lo[d], p[d]);
+                hi[d] = std::max(hi[d], p[d]);
+            }
+        }
+        if (end - begin <= LEAF_SIZE)
+        {
+            return id;
+        }
+
+        int dim = 0;
+        for (int d = 1; d < SCORE_FEATURES; ++d)
+        {
+            if (static_cast<int64_t>(hi[d]) - lo[d] > static_cast<int64_t>(hi[dim]) - lo[dim])
+            {
+                dim = d;
+            }
+        }
+        if (hi[dim] == lo[dim])
+        {
+            // Every row in this range is identical; nothing left to split on
+            return id;
+        }
+
+        size_t mid = begin + (end - begin) / 2;
+        std::nth_element(order.begin() + begin, order.begin() + mid, order.begin() + end,
+                         [&](uint32_t a, uint32_t b) {
+                             return points_[static_cast<size_t>(a) * SCORE_FEATURES + dim]
+                                 < points_[static_cast<size_t>(b) * SCORE_FEATURES + dim];
+                         });
+        int32_t left = buildNode(order, begin, mid);
+        int32_t right = buildNode(order, mid, end);
+        nodes_[id].left = left;
+        nodes_[id].right = right;
+        return id;
+    }
+
+    void growBox(int32_t id, const int32_t *point)
+    {
+    /**
+     * @brief Extends node id's box to contain a point
+     */
+        int32_t *lo = &boxes_[static_cast<size_t>(id) * 2 * SCORE_FEATURES];
+        int32_t *hi = lo + SCORE_FEATURES;
+        for (int d = 0; d < SCORE_FEATURES; ++d)
+        {
+            lo[d] = std::min(lo[d], point[d]);
+            hi[d] = std::max(hi[d], point[d]);
+        }
+    }
+
+    int64_t boxDistance(int32_t id, const ScoreSetpoint &sp) const
+    {
+    /**
+     * @brief Smallest possible squared distance from the setpoint to any row in node id
+     */
+        const int32_t *lo = &boxes_[static_cast<size_t>(id) * 2 * SCORE_FEATURES];
+        const int32_t *hi = lo + SCORE_FEATURES;
+        int64_t sum = 0;
+        for (int d = 0; d < SCORE_FEATURES; ++d)
+        {
+            int64_t q = sp.value[d];
+            int64_t gap = q < lo[d] ? lo[d] - q : (q > hi[d] ? q - hi[d] : 0);
+            sum += gap * gap;
+        }
+        return sum;
+    }
+
+    void offer(Search &search, int64_t dist2, uint32_t row) const
+    {
+        Closer closer{table_};
+        Neighbour candidate{dist2, row};
+        if (search.heap.size() < search.k)
+        {
+            search.heap.push_back(candidate);
+            std::push_heap(search.heap.begin(), search.heap.end(), closer);
+        }
+        else if (closer(candidate, search.heap.front()))
+        {
+            std::pop_heap(search.heap.begin(), search.heap.end(), closer);
+            search.heap.back() = candidate;
+            std::push_heap(search.heap.begin(), search.heap.end(), closer);
+        }
+    }
+
+    bool outsideWindow(int32_t id, const FeatureWindow *window) const
+    {
+    /**
+     * @brief True if node id has no live rows or none of its rows can be inside the window
+     */
+        if (live_[id] == 0)
+        {
+            return true;
+        }
+        if (window == nullptr)
+        {
+            return false;
+        }
+        const int32_t *lo = &boxes_[static_cast<size_t>(id) * 2 * SCORE_FEATURES];
+        const int32_t *hi = lo + SCORE_FEATURES;
+        return hi[window->feature] < window->lo || lo[window->feature] > window->hi;
+    }
+
+    void visit(int32_t id, Search &search) const
+    {
+        ++search.visited;
+        const Node &node = nodes_[id];
+        if (node.left < 0)
+        {
+            const FeatureWindow *window = search.window;
+            for (uint32_t pos = node.begin; pos < node.end; ++pos)
+            {
+                const int32_t *p = &points_[static_cast<size_t>(pos) * SCORE_FEATURES];
+                if (!alive_[pos]
+                    || (window != nullptr && (p[window->feature] < window->lo || p[window->feature] > window->hi)))
+                {
+                    continue;
+                }
+                int64_t sum = 0;
+                for (int d = 0; d < SCORE_FEATURES; ++d)
+                {
+                    int64_t diff = search.sp.value[d] - p[d];
+                    sum += diff * diff;
+                }
+                offer(search, sum, rows_[pos]);
+            }
+            return;
+        }
+
+        // an empty or out-of-window child is never visited
+        const int64_t skip = INT64_MAX;
+        int64_t leftDist = outsideWindow(node.left, search.window) ? skip : boxDistance(node.left, search.sp);
+        int64_t rightDist = outsideWindow(node.right, search.window) ? skip : boxDistance(node.right, search.sp);
+        int32_t nearChild = leftDist <= rightDist ? node.left : node.right;
+        int32_t farChild = leftDist <= rightDist ? node.right : node.left;
+        int64_t nearDist = std::min(leftDist, rightDist);
+        int64_t farDist = std::max(leftDist, rightDist);
+
+        // Only prune subtrees strictly farther than the K-th best: one at exactly that
+        // distance may still win on artist
+        if (nearDist != skip && (search.heap.size() < search.k || nearDist <= search.heap.front().dist2))
+        {
+            visit(nearChild, search);
+        }
+        if (farDist != skip && (search.heap.size() < search.k || farDist <= search.heap.front().dist2))
+        {
+            visit(farChild, search);
+        }
+    }
+
+    const SongTable *table_ = nullptr;
+    std::vector<Node> nodes_;
+    std::vector<int32_t> boxes_;    // per node: SCORE_FEATURES lows then SCORE_FEATURES highs
+    std::vector<int32_t> points_;   // row-major features in tree order
+    std::vector<uint32_t> rows_;    // SongTable row of each point, in tree order
+    std::vector<uint32_t> position_;    // tree order position of each SongTable row
+    std::vector<uint8_t> alive_;    // per position: 0 once removed
+    std::vector<uint32_t> live_;    // per node: rows not removed yet
+    std::vector<int32_t> path_;     // remove() scratch: root-to-leaf node ids
+};
+
+#endif // PLAYLIST_KD_TREE_H
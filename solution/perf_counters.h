@@ -0,0 +1,163 @@
+/**
+ * @file perf_counters.h
+ * @brief Hardware counters around a block of code, read through Linux perf_event_open.
+ * Cycles, instructions, cache references/misses and branch misses are opened as one group so
+ * they are scheduled together and their ratios are meaningful. When perf events are not
+ * available (non-Linux, containers, perf_event_paranoid too high) every reading is reported as
+ * unavailable and timing still works.
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef PLAYLIST_PERF_COUNTERS_H
+#define PLAYLIST_PERF_COUNTERS_H
+
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#define PLAYLIST_PERF_EVENTS 1
+#endif
+
+/**
+ * @brief One reading of the counter group
+ *
+ */
+struct PerfReading
+{
+    bool valid = false;
+    uint64_t cycles = 0;
+    uint64_t instructions = 0;
+    uint64_t cacheReferences = 0;
+    uint64_t cacheMisses = 0;
+    uint64_t branchMisses = 0;
+
+    double ipc() const { return cycles > 0 ? static_cast<double>(instructions) / cycles : 0; }
+    double cacheMissRate() const
+    {
+        return cacheReferences > 0 ? static_cast<double>(cacheMisses) / cacheReferences : 0;
+    }
+};
+
+/**
+ * @brief Counter group for the calling thread, user space only
+ *
+ */
+class PerfCounters
+{
+public:
+    PerfCounters()
+    {
+#ifdef PLAYLIST_PERF_EVENTS
+        const uint64_t configs[EVENTS] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+                                          PERF_COUNT_HW_CACHE_REFERENCES, PERF_COUNT_HW_CACHE_MISSES,
+                                          PERF_COUNT_HW_BRANCH_MISSES};
+        for (int e = 0; e < EVENTS; ++e)
+        {
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = configs[e];
+            attr.disabled = e == 0;     // the leader starts the whole group
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_GROUP;
+            fd_[e] = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, e == 0 ? -1 : fd_[0], 0));
+            if (fd_[e] < 0)
+            {
+                close();
+                return;
+            }
+        }
+#endif
+    }
+
+    ~PerfCounters() { close(); }
+
+    PerfCounters(const PerfCounters &) = delete;
+    PerfCounters &operator=(const PerfCounters &) = delete;
+
+    bool available() const { return fd_[0] >= 0; }
+
+    void start()
+    {
+#ifdef PLAYLIST_PERF_EVENTS
+        if (available())
+        {
+            ioctl(fd_[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+            ioctl(fd_[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        }
+#endif
+    }
+
+    PerfReading stop()
+    {
+    /**
+     * @brief Stops the group and returns the counts since start()
+     */
+        PerfReading reading;
+#ifdef PLAYLIST_PERF_EVENTS
+        if (available())
+        {
+            ioctl(fd_[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+            uint64_t values[1 + EVENTS];    // number of events, then one value per event
+            if (read(fd_[0], values, sizeof(values)) == static_cast<ssize_t>(sizeof(values)))
+            {
+                reading.valid = true;
+                reading.cycles = values[1];
+                reading.instructions = values[2];
+                reading.cacheReferences = values[3];
+                reading.cacheMisses = values[4];
+                reading.branchMisses = values[5];
+            }
+        }
+#endif
+        return reading;
+    }
+
+private:
+    static const int EVENTS = 5;
+
+    void close()
+    {
+#ifdef PLAYLIST_PERF_EVENTS
+        for (int e = EVENTS - 1; e >= 0; --e)
+        {
+            if (fd_[e] >= 0)
+            {
+                ::close(fd_[e]);
+                fd_[e] = -1;
+            }
+        }
+#endif
+    }
+
+    int fd_[EVENTS] = {-1, -1, -1, -1, -1};
+};
+
+inline void printPerfReading(const PerfReading &reading, std::ostream &out)
+{
+/**
+ * @brief Prints IPC and miss rates, or a note that counters were unavailable
+ *
+ * @param reading - counts from PerfCounters::stop
+ * @param out - stream to print to
+ */
+    if (!reading.valid)
+    {
+        out << "counters unavailable";
+        return;
+    }
+    out << "IPC " << reading.ipc() << ", " << reading.instructions << " instr, "
+        << reading.cacheMisses << " cache misses (" << reading.cacheMissRate() * 100 << "%), "
+        << reading.branchMisses << " branch misses";
+}
+
+#endif // PLAYLIST_PERF_COUNTERS_H
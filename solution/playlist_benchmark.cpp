@@ -0,0 +1,198 @@
+/**
+ * @file playlist_benchmark.cpp
+ * @brief Per-phase benchmark of the reference playlist pipeline on synthetic catalogs.
+ * For each catalog size a synthetic CSV is generated (see synthetic_catalog.h), then
+ * readFile, the structural CSV index on each SIMD path the CPU supports, forEachSongRow over
+ * the mapped file, the calcDJScore loop, sort(compareSong), print_playlist and the buffered
+ * PlaylistWriter (text and jsonl) are timed one at a time. Each phase reports wall time,
+ * throughput and, where perf_event_open is allowed, instructions per cycle, cache misses and
+ * branch misses.
+ *
+ * Build: g++ -std=c++17 -O2 playlist_benchmark.cpp -o playlist_benchmark
+ * Usage: ./playlist_benchmark [rows ...] [--seed N] [--sample DIR] [--tmp DIR]
+ *   rows defaults to 1000 10000 100000 1000000; sizes up to 50M work given the memory
+ *   (roughly 200 bytes per song in vector<Song>).
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "song.h"
+#include "dj_score.h"
+#include "playlist_io.h"
+#include "csv_mmap.h"
+#include "playlist_writer.h"
+#include "perf_counters.h"
+#include "synthetic_catalog.h"
+
+using namespace std;
+
+template <typename Fn>
+void runPhase(const string &name, size_t rows, size_t bytes, Fn &&run)
+{
+/**
+ * @brief Times one phase and prints wall time, throughput and hardware counters
+ *
+ * @param name - phase label
+ * @param rows - songs processed, for songs/sec
+ * @param bytes - bytes read or written, for MB/s (0 to omit)
+ * @param run - the phase
+ */
+    PerfCounters counters;
+    auto start = chrono::steady_clock::now();
+    counters.start();
+    run();
+    PerfReading reading = counters.stop();
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    cout << "  " << name << string(name.size() < 12 ? 12 - name.size() : 1, ' ')
+         << seconds * 1000 << " ms  " << static_cast<long long>(seconds > 0 ? rows / seconds : 0) << " songs/sec";
+    if (bytes > 0)
+    {
+        cout << "  " << (seconds > 0 ? bytes / 1e6 / seconds : 0) << " MB/s";
+    }
+    cout << "  [";
+    printPerfReading(reading, cout);
+    cout << "]" << endl;
+}
+
+int main(int argc, char *argv[])
+{
+    vector<uint64_t> sizes;
+    uint64_t seed = 1;
+    string sampleDir = "../student_code";
+    string tmpDir = "/tmp";
+    for (int i = 1; i < argc; ++i)
+    {
+        string arg = argv[i];
+        if (arg == "--seed" && i + 1 < argc)
+        {
+            seed = strtoull(argv[++i], nullptr, 10);
+        }
+        else if (arg == "--sample" && i + 1 < argc)
+        {
+            sampleDir = argv[++i];
+        }
+        else if (arg == "--tmp" && i + 1 < argc)
+        {
+            tmpDir = argv[++i];
+        }
+        else
+        {
+            sizes.push_back(strtoull(arg.c_str(), nullptr, 10));
+        }
+    }
+    if (sizes.empty())
+    {
+        sizes = {1000, 10000, 100000, 1000000};
+    }
+
+    vector<Song> sample;
+    for (const char *name : {"1990.csv", "2000.csv", "2010.csv"})
+    {
+        ifstream inFile(sampleDir + "/" + name);
+        if (!inFile)
+        {
+            cerr << "Could not open " << sampleDir + "/" + name << endl;
+            return 1;
+        }
+        readFile(inFile, sample);
+    }
+    SyntheticCatalog catalog(sample, seed);
+    if (!PerfCounters().available())
+    {
+        cout << "perf_event_open not available: reporting wall time only" << endl;
+    }
+
+    const string csvPath = tmpDir + "/playlist_benchmark.csv";
+    const string playlistPath = tmpDir + "/playlist_benchmark.txt";
+    for (uint64_t rows : sizes)
+    {
+        cout << rows << " songs (seed " << seed << ")" << endl;
+
+        size_t csvBytes = 0;
+        runPhase("generate", rows, 0, [&] {
+            ofstream outFile(csvPath, ios::binary);
+            catalog.writeCsv(outFile, 0, rows);
+            csvBytes = static_cast<size_t>(outFile.tellp());
+        });
+
+        vector<Song> songData;
+        songData.reserve(rows);
+        runPhase("readFile", rows, csvBytes, [&] {
+            ifstream inFile(csvPath);
+            readFile(inFile, songData);
+        });
+        if (songData.empty())
+        {
+            cerr << "Generated catalog is empty" << endl;
+            return 1;
+        }
+
+        MappedFile mapped;
+        if (mapped.open(csvPath))
+        {
+            for (CsvScanPath path : {CsvScanPath::Scalar, CsvScanPath::SSE2, CsvScanPath::AVX2})
+            {
+                if (!csvScanPathSupported(path))
+                {
+                    continue;
+                }
+                CsvStructuralIndex index(path);
+                size_t newlines = 0;
+                runPhase(string("index ") + csvScanPathName(path), rows, csvBytes, [&] {
+                    index.scanBlocks(mapped.view(), [&newlines](size_t, uint64_t, uint64_t rowEnds) {
+                        newlines += __builtin_popcountll(rowEnds);
+                        return true;
+                    });
+                });
+            }
+            runPhase("parse mmap", rows, csvBytes, [&] {
+                forEachSongRow(mapped.view(), [](const SongRowView &) {});
+            });
+        }
+
+        Song setpointSong = songData[songData.size() / 2];
+        runPhase("calcDJScore", rows, 0, [&] {
+            for (Song &song : songData)
+            {
+                song.dj_score = calcDJScore(song, setpointSong);
+            }
+        });
+
+        runPhase("sort", rows, 0, [&] { sort(songData.begin(), songData.end(), compareSong); });
+
+        size_t playlistBytes = 0;
+        runPhase("print", rows, 0, [&] {
+            ofstream outFile(playlistPath);
+            print_playlist(songData, outFile);
+            playlistBytes = static_cast<size_t>(outFile.tellp());
+        });
+        for (PlaylistFormat format : {PlaylistFormat::Text, PlaylistFormat::JsonLines})
+        {
+            string name = format == PlaylistFormat::Text ? "write text" : "write jsonl";
+            runPhase(name, rows, 0, [&] {
+                ofstream outFile(playlistPath);
+                PlaylistWriter writer(outFile, format);
+                writer.begin(songData.size());
+                for (const Song &song : songData)
+                {
+                    writer.song(song.dj_score, song.title, song.artist, song.genre, song.year, song.dur);
+                }
+            });
+        }
+        cout << "  (" << csvBytes / 1e6 << " MB CSV in, " << playlistBytes / 1e6 << " MB playlist out)" << endl;
+    }
+    remove(csvPath.c_str());
+    remove(playlistPath.c_str());
+    return 0;
+}
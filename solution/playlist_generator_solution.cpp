@@ -1,285 +1,1757 @@
-/**
- * @file playlist_generator.cpp
- * @authors Isha Bhatt (ibhatt), Mary Silvio (msilvio), Harsh Jhaveri (hjhaveri)
- * @brief A framework for reading in and processing Spotify song data from CSV files.
- * Once song data is read in, tunable parameters can be utilized to create and optimize playlist output.
- * This file contains the implementation of all necessary C++ code and function docstrings.
- *
- * Dataset Source: https://www.kaggle.com/cnic92/spotify-past-decades-songs-50s10s
- *
- * @version 2.0
- * @date 2023-03-20
- *
- * @copyright Copyright (c) 2023
- *
- */
-
-// Libraries to include
-#include <string>
-#include <vector>
-#include <fstream>
-#include <iostream>
-#include <sstream>
-#include <cmath>
-#include <algorithm>
-
-using namespace std;
-
-// DEFINITIONS
-
-/**
- * @brief Song structure to represent our song attributes in C++
- * Dataset: https://www.kaggle.com/cnic92/spotify-past-decades-songs-50s10s
- *
- */
-struct Song
-{
-    string title;
-    string artist;
-    string genre;
-    int year;               // Release (or Re-Release Year)
-    int bpm;                // Beats Per Minute
-    int nrgy;               // Energy - The energy of a song - the higher the value, the more energetic the song
-    int dnce;               // Danceability - The higher the value, the easier it is to dance to this song
-    int dB;                 // Loudness (dB) - The higher the value, the louder the song
-    int live;               // Liveness - The higher the value, the more likely the song is a live recording
-    int val;                // Valence - the higher the value, the more positive mood for the song.
-    int dur;                // Duration of the song (sec)
-    int acous;              // Acousticness - The higher the value of the more acoustic the song is
-    int spch;               // Spechiness - the higher the value, the more spoken word the song contains
-    int pop;                // Popularity - the higher the value, the more popular the song is
-    double dj_score;        // dj_score - A custom score used to calculate the "fit" of the song to your playlist
-};
-
-
-// HELPER FUNCTIONS
-void readFile(istream &inFile, vector<Song> &songData)
-{
-/**
- * @brief Function used to read song data into vector
- *
- * @param inFile - input file stream, used to read in Song Data
- * @param songData - vector of all song data
- */
-    // Create necessary variables
-    string line;
-    Song song;
-    string val;
-    string id;
-
-    // Read in header line
-    getline(inFile, line);
-
-    // Read in all other lines which include song data
-    while(getline(inFile, line))
-    {
-        // Create stringstream to parse line
-        stringstream songLine(line);
-
-        // Read in each attribute one at a time
-        getline(songLine, id, ','); // song ID - We don't care about this
-        getline(songLine, song.title, ',');
-        getline(songLine, song.artist, ',');
-        getline(songLine, song.genre, ',');
-
-        getline(songLine, val, ','); // year
-        song.year = stoi(val);
-
-        getline(songLine, val, ','); // bpm
-        song.bpm = stoi(val);
-
-        getline(songLine, val, ','); // nrgy
-        song.nrgy = stoi(val);
-
-        getline(songLine, val, ','); // dnce
-        song.dnce = stoi(val);
-
-        getline(songLine, val, ','); // db
-        song.dB = stoi(val);
-
-        getline(songLine, val, ','); // live
-        song.live = stoi(val);
-
-        getline(songLine, val, ','); // val
-        song.val = stoi(val);
-
-        getline(songLine, val, ','); // dur
-        song.dur = stoi(val);
-
-        getline(songLine, val, ','); // acous
-        song.acous = stoi(val);
-
-        getline(songLine, val, ','); // spch
-        song.spch = stoi(val);
-
-        getline(songLine, val); // pop
-        song.pop = stoi(val);
-
-        // set DJ score to 0 for now
-        song.dj_score = 0;
-
-        // Add song to songData vector
-        songData.push_back(song);
-    }
-}
-
-void getSetpointSong(vector<Song> &songData, Song &setpointSong){
-/**
- * @brief Modifies setpoint song based on a song title
- * @param songData - vector of all songs (unsorted)
- * @param setpointSong - song that will be set with input data 
- */
-    string query_title;
-    bool setSong = false;
-    while(setSong == false){
-        cout << "Enter a song title: ";
-        // use getline since a song could be multiple words
-        getline(cin, query_title);
-        
-        // check entire vector for matching song
-        for(int i = 0; i < songData.size(); ++i){
-            if(songData.at(i).title == query_title){
-                // update setpoint song member values to chosen song
-                setpointSong.year = songData.at(i).year;
-                setpointSong.bpm = songData.at(i).bpm;
-                setpointSong.nrgy = songData.at(i).nrgy;
-                setpointSong.dnce = songData.at(i).dnce;
-                setpointSong.dB = songData.at(i).dB;
-                setpointSong.live = songData.at(i).live;
-                setpointSong.val = songData.at(i).val;
-                setpointSong.dur = songData.at(i).dur;
-                setpointSong.acous = songData.at(i).acous;
-                setpointSong.spch = songData.at(i).spch;
-                setpointSong.pop = songData.at(i).pop;
-
-                cout << query_title << " has been set as the playlist starter!" << endl;
-                setSong = true;
-                break;
-            }
-        } 
-        if (setSong == false){
-            // Print message to user if song not found
-            cout << "No match found for " << query_title << ". Please enter a valid song." << endl;
-        }
-    }
-}
-
-double calcDJScore(const Song &song, const Song &setpointSong)
-{
-/**
- * @brief Function used to calculate dj_score for each Song object.
- * Score is calculated based on a modified Mean Squared Error, thus a lower score
- * is better
- *
- * @param song - Song object to calculate dj_score for
- * @param setpointSong - Song object to compare song to in calculations
- */
-    // Create base score variable
-    double dj_score = 0;
-
-    // Update score
-    dj_score += pow(abs(setpointSong.year - song.year), 2);
-    dj_score += pow(abs(setpointSong.bpm - song.bpm), 2);
-    dj_score += pow(abs(setpointSong.nrgy - song.nrgy), 2);
-    dj_score += pow(abs(setpointSong.dnce - song.dnce), 2);
-    dj_score += pow(abs(setpointSong.dB - song.dB), 2);
-    dj_score += pow(abs(setpointSong.live - song.live), 2);
-    dj_score += pow(abs(setpointSong.val - song.val), 2);
-    dj_score += pow(abs(setpointSong.dur - song.dur), 2);
-    dj_score += pow(abs(setpointSong.acous - song.acous), 2);
-    dj_score += pow(abs(setpointSong.spch - song.spch), 2);
-    dj_score += pow(abs(setpointSong.pop - song.pop), 2);
-    
-    // Return score
-    return sqrt(dj_score);
-}
-
-bool compareSong(Song song1, Song song2)
-{
-/**
- * @brief Custom comparator used to compare the dj_score of all songs.
- * Will sort the songs in ascending order based on dj_score. If the dj_score
- * is within 0.0005 of another song, then songs are sorted based on artist name.
- *
- * @param song1 - the first song to compare
- * @param song2 - the second song to compare the first song to
- */
-    // First sort by minimizing the DJ score
-    if (abs(song1.dj_score-song2.dj_score) > 0.0005)
-    {
-        return song1.dj_score < song2.dj_score;
-    }
-    // If ties exist, alphabetize by the artist's name
-    else
-    {
-        return song1.artist < song2.artist;
-    }
-}
-
-void print_playlist(vector<Song> & sortedSongData, ostream & out)
-{
-/**
- * @brief Print function used to print songs to the terminal
- *
- * @param sortedSongData - vector of all song data
- * @param out - the output stream where playlist information will be output to
- */
-    out << "Playlist created using data from " << sortedSongData.size() << " songs!" << endl;
-    for(int i = 0; i < sortedSongData.size(); i++)
-    {
-        out << i+1  << " - "
-             << " DJ Score: " << sortedSongData[i].dj_score << endl
-             << "\t\t" << sortedSongData[i].title // The \t character is an escape sequence for a tab!
-             << " by " << sortedSongData[i].artist
-             << " from " << sortedSongData[i].year << endl;
-    }
-}
-
-
-
-int main()
-{
-    // Create vector of songs
-    vector<Song> songData;
-    /*
-     * Create input file streams.
-     */
-    ifstream in1990("1990.csv");
-    ifstream in2000("2000.csv");
-    ifstream in2010("2010.csv");
-
-    /**
-     * Read data from each file stream. You will need to call
-     * the readFile() function once for each filestream
-     */
-    readFile(in1990, songData);
-    in1990.close();
-    readFile(in2000, songData);
-    in2000.close();
-    readFile(in2010, songData);
-    in2010.close();
-
-    /**
-     * Query user for song title to define song attribute setpoints.
-     * When song is found in vector, output song has been set to start
-     * the playlist, otherwise re-prompt user for song title
-     */
-    Song setpointSong;
-    getSetpointSong(songData, setpointSong);
-
-    // calculate DJ scores
-    for(int i = 0; i < songData.size(); ++i){
-        songData.at(i).dj_score = calcDJScore(songData.at(i), setpointSong);
-    }
-
-    // Sort your vector!
-    sort(songData.begin(), songData.end(), compareSong);
-
-    // Print out your developed playlist!
-    cout << "Creating playlist..." << endl;
-    ofstream outFile("playlist.txt");
-    print_playlist(songData, outFile);
-    outFile.close();
-    cout << "Playlist complete!" << endl;
-    return 0;
-}
+/**
+ * @file playlist_generator.cpp
+ * @authors Isha Bhatt (ibhatt), Mary Silvio (msilvio), Harsh Jhaveri (hjhaveri)
+ * @brief A framework for reading in and processing Spotify song data from CSV files.
+ * Once song data is read in, tunable parameters can be utilized to create and optimize playlist output.
+ * This file contains the implementation of all necessary C++ code and function docstrings.
+ *
+ * Dataset Source: https://www.kaggle.com/cnic92/spotify-past-decades-songs-50s10s
+ *
+ * Build: g++ -std=c++17 -O2 playlist_generator_solution.cpp -o playlist_generator
+ *
+ * @version 2.0
+ * @date 2023-03-20
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+// Libraries to include
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <cmath>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iterator>
+#include <atomic>
+#include <thread>
+
+#include "song.h"
+#include "dj_score.h"
+#include "playlist_io.h"
+#include "playlist_writer.h"
+#include "csv_mmap.h"
+#include "song_table.h"
+#include "score_kernels.h"
+#include "score_weights.h"
+#include "top_k.h"
+#include "title_index.h"
+#include "ingest.h"
+#include "kd_tree.h"
+#include "snapshot.h"
+#include "stream_top_k.h"
+#include "incremental_rank.h"
+#include "dj_set.h"
+#include "ivf_pq.h"
+#include "run_stats.h"
+#include "query_cache.h"
+#include "filter_index.h"
+#include "radix_sort.h"
+#include "dedup.h"
+#include "early_abandon.h"
+
+using namespace std;
+
+/**
+ * @brief Command line options for a playlist run
+ *
+ */
+struct PlaylistOptions
+{
+    bool useMmap = false;   // load with the memory-mapped loader instead of readFile
+    bool useTable = false;  // rank a column-oriented SongTable instead of vector<Song>
+    size_t topK = 0;        // only keep the best topK songs (0 = whole catalog)
+    string catalogPath;     // directory or glob of CSV shards loaded through the ingest pipeline
+    unsigned threads = thread::hardware_concurrency();
+    bool useKdTree = false; // answer the query from a k-d tree instead of scoring every row
+    string snapshotPath;    // binary snapshot to load from, or to write after parsing the CSVs
+    bool verifySnapshot = true;     // rehash the source CSVs before trusting the snapshot
+    string batchPath;       // seed titles to answer in one run ("-" = stdin)
+    string outPath;         // playlist output ("-" = stdout, default playlist.<format>)
+    PlaylistFormat format = PlaylistFormat::Text;   // layout of the written playlist
+    string outDir;          // if set, write one playlist file per batch seed here instead
+    ScoreConfig scoreConfig;    // per-feature weights and normalization
+    bool stream = false;    // one sequential pass keeping only the top K, nothing else in memory
+    string setpointFeatures;    // explicit setpoint features for --stream
+    string setpointTitle;       // setpoint title for --stream, instead of prompting
+    vector<string> inputs;      // explicit CSV inputs ("-" = stdin), replacing the decade files
+    bool tune = false;          // nudge the setpoint interactively before writing the playlist
+    bool sequence = false;      // order the playlist as a nearest-neighbour chain from the seed
+    int maxBpmJump = -1;        // largest bpm change between consecutive --sequence tracks (-1 = any)
+    bool useIvf = false;        // answer --top K approximately from an IVF-PQ index
+    IvfPqConfig ivfConfig;      // index build and probe settings
+    size_t recallQueries = 0;   // measure the index's recall@K over this many queries first
+    bool stats = false;         // time each phase and print a JSON report to stderr
+    size_t cacheBytes = 64 << 20;   // --batch result cache budget (0 = no cache)
+    string filter;              // only rank songs matching this filter expression
+    bool radix = false;         // order full rankings with the packed-key radix sort
+    DedupPolicy dedup = DedupPolicy::None;  // which copy of a song listed more than once is kept
+    bool earlyAbandon = false;  // answer --top K by a scan that stops summing hopeless songs early
+};
+
+
+// HELPER FUNCTIONS
+template <typename ArtistAt>
+bool chooseTitleMatch(const TitleIndex &titleIndex, const string &query_title, ArtistAt artistAt, uint32_t &row)
+{
+/**
+ * @brief Resolves a typed title to a single row. Titles are matched ignoring case and extra
+ * whitespace; if songs by different artists share the title the user is asked for the artist.
+ *
+ * @param titleIndex - index over the catalog's titles
+ * @param query_title - title as typed by the user
+ * @param artistAt - artistAt(i) returns the artist of row i
+ * @param row - receives the chosen row
+ * @return true if a song was chosen
+ */
+    TitleMatches matches = titleIndex.find(query_title);
+    if (matches.empty())
+    {
+        return false;
+    }
+    row = *matches.begin();
+
+    bool ambiguous = false;
+    for (uint32_t candidate : matches)
+    {
+        ambiguous = ambiguous || artistAt(candidate) != artistAt(row);
+    }
+    if (!ambiguous)
+    {
+        return true;
+    }
+
+    cout << query_title << " is by more than one artist:" << endl;
+    for (uint32_t candidate : matches)
+    {
+        cout << "\t" << artistAt(candidate) << endl;
+    }
+    cout << "Enter the artist: ";
+    string query_artist;
+    getline(cin, query_artist);
+    vector<uint32_t> byArtist = titleIndex.find(query_title, query_artist, artistAt);
+    if (byArtist.empty())
+    {
+        return false;
+    }
+    row = byArtist.front();
+    return true;
+}
+
+void getSetpointSong(const vector<Song> &songData, const TitleIndex &titleIndex, Song &setpointSong){
+/**
+ * @brief Modifies setpoint song based on a song title
+ * @param songData - vector of all songs (unsorted)
+ * @param titleIndex - title index built over songData at load time
+ * @param setpointSong - song that will be set with input data 
+ */
+    string query_title;
+    bool setSong = false;
+    while(setSong == false){
+        cout << "Enter a song title: ";
+        // use getline since a song could be multiple words
+        getline(cin, query_title);
+        
+        uint32_t row;
+        auto artistAt = [&songData](uint32_t i) -> const string & { return songData[i].artist; };
+        if (chooseTitleMatch(titleIndex, query_title, artistAt, row)){
+            // update setpoint song member values to chosen song
+            copyFeatures(songData[row], setpointSong);
+
+            cout << query_title << " has been set as the playlist starter!" << endl;
+            setSong = true;
+        }
+        else{
+            // Print message to user if song not found
+            cout << "No match found for " << query_title << ". Please enter a valid song." << endl;
+        }
+    }
+}
+
+void getSetpointSong(const SongTable &songTable, const TitleIndex &titleIndex, Song &setpointSong){
+/**
+ * @brief Modifies setpoint song based on a song title, looked up in a SongTable
+ * @param songTable - column-oriented catalog of all songs
+ * @param titleIndex - title index built over songTable at load time
+ * @param setpointSong - song that will be set with input data
+ */
+    string query_title;
+    bool setSong = false;
+    while(setSong == false){
+        cout << "Enter a song title: ";
+        getline(cin, query_title);
+
+        uint32_t row;
+        auto artistAt = [&songTable](uint32_t i) { return songTable.text.artist(i); };
+        if (chooseTitleMatch(titleIndex, query_title, artistAt, row)){
+            setpointSong = songTable.row(row);
+            cout << query_title << " has been set as the playlist starter!" << endl;
+            setSong = true;
+        }
+        else{
+            cout << "No match found for " << query_title << ". Please enter a valid song." << endl;
+        }
+    }
+}
+
+size_t print_playlist(const vector<Song> &sortedSongData, size_t sourceSongs, ostream &out, PlaylistFormat format)
+{
+/**
+ * @brief Buffered print function for a sorted vector<Song>. With PlaylistFormat::Text and
+ * sourceSongs = sortedSongData.size() the output is identical to print_playlist(sortedSongData, out).
+ *
+ * @param sortedSongData - songs in playlist order
+ * @param sourceSongs - number of songs the playlist was ranked from
+ * @param out - the output stream where playlist information will be output to
+ * @param format - output layout
+ * @return bytes written to out
+ */
+    PlaylistWriter writer(out, format);
+    writer.begin(sourceSongs);
+    for (const Song &song : sortedSongData)
+    {
+        writer.song(song.dj_score, song.title, song.artist, song.genre, song.year, song.dur);
+    }
+    writer.flush();
+    return writer.bytesWritten();
+}
+
+size_t print_playlist(const vector<Song> &songData, const vector<uint32_t> &order, ostream &out,
+                    PlaylistFormat format = PlaylistFormat::Text)
+{
+/**
+ * @brief Print function for a playlist given as indices into songData, e.g. a top-K selection
+ *
+ * @param songData - vector of all song data
+ * @param order - indices into songData in playlist order
+ * @param out - the output stream where playlist information will be output to
+ * @param format - output layout
+ * @return bytes written to out
+ */
+    PlaylistWriter writer(out, format);
+    writer.begin(songData.size());
+    for (uint32_t index : order)
+    {
+        const Song &song = songData[index];
+        writer.song(song.dj_score, song.title, song.artist, song.genre, song.year, song.dur);
+    }
+    writer.flush();
+    return writer.bytesWritten();
+}
+
+size_t print_playlist(const SongTable &songTable, size_t sourceSongs, const vector<uint32_t> &order,
+                    const vector<double> &scores, ostream &out, PlaylistFormat format = PlaylistFormat::Text, long long seed = -1,
+                    bool fileHeader = true)
+{
+/**
+ * @brief Print function for a ranked SongTable, same layouts as the vector<Song> version
+ *
+ * @param songTable - catalog the rows belong to
+ * @param sourceSongs - number of rows the playlist was ranked from, after any filter
+ * @param order - row indices in playlist order
+ * @param scores - dj_score per row
+ * @param out - the output stream where playlist information will be output to
+ * @param format - output layout
+ * @param seed - batch seed number for the csv/jsonl seed column, -1 for none
+ * @param fileHeader - write the format's file header (csv header, #EXTM3U) first
+ * @return bytes written to out
+ */
+    PlaylistWriter writer(out, format, fileHeader);
+    writer.begin(sourceSongs, seed);
+    for (uint32_t row : order)
+    {
+        writer.song(scores[row], songTable.text.title(row), songTable.text.artist(row),
+                    songTable.text.genre(row), songTable.column<featureIndex("year")>()[row],
+                    songTable.column<featureIndex("dur")>()[row]);
+    }
+    writer.flush();
+    return writer.bytesWritten();
+}
+
+template <typename PrintFn>
+void writePlaylistOutput(const PlaylistOptions &options, PrintFn print)
+{
+/**
+ * @brief Opens the playlist destination (options.outPath, "-" for stdout, or the format's
+ * default file name) and hands it to print
+ *
+ * @param options - command line options
+ * @param print - print(ostream &) writes the playlist
+ */
+    if (options.outPath == "-")
+    {
+        print(cout);
+        cout.flush();
+        return;
+    }
+    ofstream outFile(options.outPath.empty() ? playlistFileName(options.format) : options.outPath);
+    print(outFile);
+}
+
+void rankSongTable(const SongTable &songTable, const WeightedScorer &scorer, const KdTree *kdTree,
+                   const IvfPqIndex *ivfIndex, const RowBitmap *filter, const Song &setpointSong,
+                   size_t topK, vector<double> &scores, vector<uint32_t> &order, unsigned radixThreads = 0,
+                   const EarlyAbandonScorer *earlyAbandon = nullptr, uint64_t *comparisons = nullptr)
+{
+/**
+ * @brief Ranks a SongTable against a setpoint. Safe to call from several threads at once as
+ * long as each passes its own scores/order buffers, which are reused between calls.
+ *
+ * @param songTable - catalog to rank
+ * @param scorer - batch kernel built over songTable
+ * @param kdTree - if not null, answer from this k-d tree instead of scoring every row; the
+ *                 tree only knows the unweighted metric, so scorer must be exact
+ * @param ivfIndex - if not null (and kdTree is), answer approximately from this index; like
+ *                   the tree it needs an exact scorer, and topK > 0
+ * @param filter - if not null (and neither index is), only these rows are scored and ranked
+ * @param setpointSong - Song object to compare rows to
+ * @param topK - playlist length (0 = whole catalog)
+ * @param scores - scratch of one entry per row; on return scores[row] is the dj_score of
+ *                 every row in order
+ * @param order - receives the playlist rows, best first
+ * @param radixThreads - if not 0, full rankings use the packed-key radix sort on this many
+ *                       threads instead of the comparison sort
+ * @param earlyAbandon - if not null (and no index or filter is), answer topK > 0 queries with
+ *                       this early-abandoning scan; it needs an exact scorer
+ * @param comparisons - if not null, comparisons made by the row sort or top-K selection are
+ *                      added to it; the k-d tree, IVF and early-abandon paths leave it alone
+ */
+    order.clear();
+    if (kdTree != nullptr)
+    {
+        // exact nearest neighbours; only the returned rows are ever scored
+        vector<Neighbour> nearest;
+        kdTree->nearest(setpointSong, topK > 0 ? topK : songTable.size(), nearest);
+        scores.resize(songTable.size());
+        for (const Neighbour &neighbour : nearest)
+        {
+            order.push_back(neighbour.row);
+            scores[neighbour.row] = static_cast<double>(neighbour.dist2);
+        }
+    }
+    else if (filter != nullptr)
+    {
+        // score only the rows the filter kept, a run of consecutive rows at a time
+        vector<uint32_t> kept;
+        scores.resize(songTable.size());
+        const ScoreSetpoint setpoint(setpointSong);
+        filter->forEachRun([&](size_t begin, size_t end) {
+            scorer.scoreBlock(setpoint, begin, end, scores.data());
+            for (size_t row = begin; row < end; ++row)
+            {
+                kept.push_back(static_cast<uint32_t>(row));
+            }
+        });
+        topKRowsOf(songTable, scores, kept, topK, order, comparisons);
+    }
+    else if (ivfIndex != nullptr)
+    {
+        // approximate nearest neighbours with exact distances
+        vector<Neighbour> nearest;
+        ivfIndex->search(ScoreSetpoint(setpointSong), topK, nearest);
+        scores.resize(songTable.size());
+        for (const Neighbour &neighbour : nearest)
+        {
+            order.push_back(neighbour.row);
+            scores[neighbour.row] = static_cast<double>(neighbour.dist2);
+        }
+    }
+    else if (earlyAbandon != nullptr && topK > 0)
+    {
+        // exact top K; most rows are dropped after a few of their squared differences
+        vector<Neighbour> nearest;
+        earlyAbandon->nearest(ScoreSetpoint(setpointSong), topK, nearest);
+        scores.resize(songTable.size());
+        for (const Neighbour &neighbour : nearest)
+        {
+            order.push_back(neighbour.row);
+            scores[neighbour.row] = static_cast<double>(neighbour.dist2);
+        }
+    }
+    else
+    {
+        // rank on squared distances from the SIMD or weighted kernel
+        scorer.squaredDistances(setpointSong, scores);
+        if (topK > 0)
+        {
+            topKRows(songTable, scores, topK, order, comparisons);
+        }
+        else if (radixThreads == 0 || !radixRankRows(songTable, scores, radixThreads, order))
+        {
+            sortRowsBySquaredDistance(songTable, scores, order, comparisons);
+        }
+    }
+    // scores hold squared distances; take the sqrt of the playlist rows
+    for (uint32_t row : order)
+    {
+        scores[row] = sqrt(scores[row]);
+    }
+}
+
+bool loadSongTable(const vector<string> &csvFiles, const PlaylistOptions &options, SongTable &songTable,
+                   RunStats &stats)
+{
+/**
+ * @brief Fills songTable from the snapshot when one is configured and still valid, otherwise
+ * parses the CSVs (and then writes the snapshot, if configured)
+ *
+ * @param csvFiles - CSV files that make up the catalog
+ * @param options - command line options
+ * @param songTable - receives the catalog
+ * @param stats - receives the load phase and parse counters
+ * @return false if the CSVs could not be loaded
+ */
+    PhaseTimer timer(stats, "load");
+    // a snapshot holds the catalog as parsed, so it is neither trusted nor written when deduplicating
+    const bool useSnapshot = !options.snapshotPath.empty() && options.dedup == DedupPolicy::None;
+    if (useSnapshot)
+    {
+        auto start = chrono::steady_clock::now();
+        SnapshotStatus status = loadSnapshot(options.snapshotPath, csvFiles, options.verifySnapshot, songTable);
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        if (status == SnapshotStatus::Loaded)
+        {
+            cout << "Loaded " << songTable.size() << " songs from snapshot " << options.snapshotPath
+                 << " in " << ms << " ms" << endl;
+            return true;
+        }
+        cout << "Snapshot " << options.snapshotPath << " is " << snapshotStatusName(status)
+             << ", parsing CSV files" << endl;
+    }
+
+    LoadStats loadStats;
+    if (!options.catalogPath.empty() || options.dedup != DedupPolicy::None)
+    {
+        IngestStats ingestStats;
+        SongDeduplicator dedup(options.dedup);
+        bool loaded = ingestCsvFiles(csvFiles, options.threads, [&](vector<Song> &&rows) {
+            for (const Song &song : rows)
+            {
+                loadStats.skipped += songTable.append(song) ? 0 : 1;
+            }
+        }, ingestStats, options.dedup != DedupPolicy::None ? &dedup : nullptr);
+        printIngestStats(ingestStats, cout);
+        if (!loaded)
+        {
+            cerr << "Could not map every CSV file" << endl;
+            return false;
+        }
+        songTable.text.rankArtists();
+        loadStats.rows = songTable.size();
+        loadStats.seconds = ingestStats.wallSeconds;
+    }
+    else
+    {
+        for (const string &path : csvFiles)
+        {
+            if (!readMappedTable(path, songTable, loadStats))
+            {
+                cerr << "Could not map " << path << endl;
+                return false;
+            }
+        }
+    }
+    stats.rowsParsed += loadStats.rows;
+    stats.parseErrors += loadStats.skipped;
+    cout << "Loaded " << loadStats.rows << " songs into SongTable in " << loadStats.seconds * 1000
+         << " ms (" << SongTable::featureBytesPerRow << " feature bytes/song, "
+         << songTable.featureBytes() << " bytes total)" << endl;
+    cout << "Interned text: " << songTable.text.memoryBytes() << " bytes, " << songTable.text.artists.size()
+         << " distinct artists, " << songTable.text.genres.size() << " distinct genres" << endl;
+
+    if (useSnapshot)
+    {
+        auto start = chrono::steady_clock::now();
+        if (writeSnapshot(options.snapshotPath, songTable, csvFiles))
+        {
+            cout << "Wrote snapshot " << options.snapshotPath << " in "
+                 << chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() << " ms" << endl;
+        }
+        else
+        {
+            cerr << "Could not write snapshot " << options.snapshotPath << endl;
+        }
+    }
+    return true;
+}
+
+bool useKdTreeFor(const WeightedScorer &scorer, const PlaylistOptions &options)
+{
+/**
+ * @brief Whether --kdtree can be honoured: the tree indexes the unweighted features, so
+ * weighted or normalized queries fall back to scoring every row
+ *
+ * @param scorer - scorer built with the query's weights
+ * @param options - command line options
+ */
+    if (options.useKdTree && !scorer.isExact())
+    {
+        cerr << "--kdtree ignored: the k-d tree only supports the default weights" << endl;
+        return false;
+    }
+    if (options.useKdTree && !options.filter.empty())
+    {
+        cerr << "--kdtree ignored: filtered queries score the rows the filter keeps" << endl;
+        return false;
+    }
+    return options.useKdTree;
+}
+
+bool useIvfFor(const WeightedScorer &scorer, const PlaylistOptions &options)
+{
+/**
+ * @brief Whether --ivf can be honoured: the index quantizes the unweighted features and only
+ * returns a bounded candidate set, so it needs the default weights and --top K
+ *
+ * @param scorer - scorer built with the query's weights
+ * @param options - command line options
+ */
+    if (options.useIvf && (!scorer.isExact() || options.topK == 0))
+    {
+        cerr << "--ivf ignored: the IVF-PQ index needs --top K and the default weights" << endl;
+        return false;
+    }
+    if (options.useIvf && !options.filter.empty())
+    {
+        cerr << "--ivf ignored: filtered queries score the rows the filter keeps" << endl;
+        return false;
+    }
+    if (options.useIvf && options.useKdTree)
+    {
+        cerr << "--ivf ignored: --kdtree already answers --top K exactly" << endl;
+        return false;
+    }
+    return options.useIvf;
+}
+
+bool useEarlyAbandonFor(const WeightedScorer &scorer, const PlaylistOptions &options, bool indexed)
+{
+/**
+ * @brief Whether --early-abandon can be honoured: it sums unweighted squared differences and
+ * only pays off against a --top K threshold
+ *
+ * @param scorer - scorer built with the query's weights
+ * @param options - command line options
+ * @param indexed - whether a k-d tree or IVF-PQ index already answers the query
+ */
+    if (options.earlyAbandon && (!scorer.isExact() || options.topK == 0))
+    {
+        cerr << "--early-abandon ignored: it needs --top K and the default weights" << endl;
+        return false;
+    }
+    if (options.earlyAbandon && !options.filter.empty())
+    {
+        cerr << "--early-abandon ignored: filtered queries score the rows the filter keeps" << endl;
+        return false;
+    }
+    if (options.earlyAbandon && indexed)
+    {
+        cerr << "--early-abandon ignored: an index already answers --top K" << endl;
+        return false;
+    }
+    return options.earlyAbandon;
+}
+
+void buildIvfIndex(const SongTable &songTable, const PlaylistOptions &options, IvfPqIndex &index)
+{
+/**
+ * @brief Builds the IVF-PQ index, reporting its size, and runs the recall measurement when
+ * --recall asked for one
+ *
+ * @param songTable - catalog to index
+ * @param options - command line options
+ * @param index - receives the index
+ */
+    auto buildStart = chrono::steady_clock::now();
+    index.build(songTable, options.ivfConfig);
+    cout << "IVF-PQ index built in "
+         << chrono::duration<double, milli>(chrono::steady_clock::now() - buildStart).count() << " ms ("
+         << index.lists() << " lists, " << index.config().subspaces << " code bytes per song, "
+         << index.memoryBytes() / 1024 << " KiB)" << endl;
+    if (options.recallQueries > 0)
+    {
+        measureIvfRecall(songTable, index, options.recallQueries, options.topK, cout);
+    }
+}
+
+bool applyFilter(const SongTable &songTable, const PlaylistOptions &options, RowBitmap &rows)
+{
+/**
+ * @brief Indexes the catalog and evaluates --filter into a row bitmap
+ *
+ * @param songTable - loaded catalog
+ * @param options - command line options; options.filter must be set
+ * @param rows - receives the rows the filter keeps
+ * @return false if the filter expression is malformed
+ */
+    auto start = chrono::steady_clock::now();
+    FilterIndex filterIndex;
+    filterIndex.build(songTable);
+    double buildMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    start = chrono::steady_clock::now();
+    string error;
+    if (!filterIndex.evaluate(options.filter, rows, error))
+    {
+        cerr << error << endl;
+        return false;
+    }
+    cout << "Filter kept " << rows.count() << " of " << songTable.size() << " songs in "
+         << chrono::duration<double, milli>(chrono::steady_clock::now() - start).count()
+         << " ms (index built in " << buildMs << " ms, " << filterIndex.memoryBytes() / 1024 << " KiB)" << endl;
+    return true;
+}
+
+uint64_t queryParamsHash(const PlaylistOptions &options, bool useKdTree, bool useIvf)
+{
+/**
+ * @brief Hash of everything besides the seed and K that decides a playlist: weights,
+ * normalization and which index answers (approximate results depend on its settings)
+ *
+ * @param options - command line options
+ * @param useKdTree - whether the k-d tree answers
+ * @param useIvf - whether the IVF-PQ index answers
+ */
+    string params(reinterpret_cast<const char *>(options.scoreConfig.weight), sizeof(options.scoreConfig.weight));
+    params += static_cast<char>(options.scoreConfig.scaling);
+    params += useKdTree ? 'k' : useIvf ? 'i' : 'x';
+    params += options.filter;
+    params += '\0';
+    if (useIvf)
+    {
+        const IvfPqConfig &ivf = options.ivfConfig;
+        for (uint64_t value : {uint64_t(ivf.lists), uint64_t(ivf.probes), uint64_t(ivf.subspaces),
+                               uint64_t(ivf.rerank), uint64_t(ivf.iterations), uint64_t(ivf.trainRows), ivf.seed})
+        {
+            params.append(reinterpret_cast<const char *>(&value), sizeof(value));
+        }
+    }
+    return hashKey(params);
+}
+
+bool parseNudge(const string &line, const ScoreSetpoint &setpoint, int &feature, int &value)
+{
+/**
+ * @brief Parses one tuning command: "name=value" sets a feature, "name +N" or "name -N"
+ * moves it
+ *
+ * @param line - command as typed
+ * @param setpoint - current setpoint, for relative moves
+ * @param feature - receives the feature index
+ * @param value - receives the new setpoint value
+ * @return false if the command is not understood
+ */
+    size_t split = line.find_first_of("= ");
+    if (split == string::npos)
+    {
+        return false;
+    }
+    feature = 0;
+    while (feature < SCORE_FEATURES && line.compare(0, split, SONG_FEATURES[feature].name) != 0)
+    {
+        ++feature;
+    }
+    size_t numberStart = line.find_first_not_of(' ', split + 1);
+    string number = numberStart == string::npos ? string() : line.substr(numberStart);
+    char *end = nullptr;
+    long parsed = strtol(number.c_str(), &end, 10);
+    if (feature == SCORE_FEATURES || number.empty() || *end != '\0')
+    {
+        return false;
+    }
+    if (line[split] == '=')
+    {
+        value = static_cast<int>(parsed);
+        return true;
+    }
+    if (number[0] != '+' && number[0] != '-')
+    {
+        return false;
+    }
+    value = setpoint.value[feature] + static_cast<int>(parsed);
+    return true;
+}
+
+bool runTuningSession(const SongTable &songTable, const Song &setpointSong, size_t preview,
+                      IncrementalRanker &ranker)
+{
+/**
+ * @brief Lets the user nudge setpoint features one at a time. Each nudge repairs the ranking
+ * incrementally, shows the new top of the playlist as soon as it is final and then finishes
+ * repairing the rest of the order.
+ *
+ * @param songTable - catalog being ranked
+ * @param setpointSong - starting setpoint
+ * @param preview - songs shown after each nudge
+ * @param ranker - ranker over songTable; left ranked against the final setpoint
+ * @return false if the catalog's feature ranges are too wide for the ranker
+ */
+    auto start = chrono::steady_clock::now();
+    if (!ranker.reset(setpointSong))
+    {
+        return false;
+    }
+    cout << "Ranked " << ranker.size() << " songs in "
+         << chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() << " ms" << endl;
+    cout << "Tune the setpoint with \"feature=value\", \"feature +N\" or \"feature -N\" (features: "
+         << featureNameList(" ") << "); \"done\" writes the playlist" << endl;
+
+    string line;
+    while (cout << "> " << flush && getline(cin, line) && line != "done")
+    {
+        int feature = 0;
+        int value = 0;
+        if (line.empty())
+        {
+            continue;
+        }
+        if (!parseNudge(line, ranker.setpoint(), feature, value))
+        {
+            cout << "Could not parse \"" << line << "\"" << endl;
+            continue;
+        }
+        start = chrono::steady_clock::now();
+        if (!ranker.setFeature(feature, value, preview))
+        {
+            cout << SONG_FEATURES[feature].name << "=" << value << " is out of range" << endl;
+            continue;
+        }
+        double readyMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        size_t shown = min(preview, ranker.size());
+        cout << SONG_FEATURES[feature].name << "=" << value << ": top " << shown << " ready in " << readyMs
+             << " ms (" << ranker.lastRunCount() << " runs merged)" << endl;
+        for (size_t i = 0; i < shown; ++i)
+        {
+            uint32_t row = ranker.row(i);
+            cout << "  " << i + 1 << " -  DJ Score: " << sqrt(static_cast<double>(ranker.dist2(i))) << "  "
+                 << songTable.text.title(row) << " by " << songTable.text.artist(row) << endl;
+        }
+        start = chrono::steady_clock::now();
+        ranker.settle();
+        cout << "  full order repaired in "
+             << chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() << " ms" << endl;
+    }
+    return true;
+}
+
+int runDjSet(const SongTable &songTable, const Song &setpointSong, const PlaylistOptions &options,
+             RunStats &runStats)
+{
+/**
+ * @brief Writes the playlist as a DJ set: a chain where each track is the nearest unused song
+ * to the one before it
+ *
+ * @param songTable - catalog to sequence
+ * @param setpointSong - seed of the set
+ * @param options - command line options; --top is the set length
+ * @param runStats - receives the phase times and bytes written
+ * @return process exit code
+ */
+    runStats.mode = "sequence";
+    auto start = chrono::steady_clock::now();
+    KdTree kdTree;
+    {
+        PhaseTimer timer(runStats, "index");
+        kdTree.build(songTable);
+    }
+    cout << "k-d tree built in "
+         << chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() << " ms" << endl;
+
+    vector<uint32_t> order;
+    vector<double> transitions;
+    DjSetStats stats;
+    start = chrono::steady_clock::now();
+    {
+        PhaseTimer timer(runStats, "sequence");
+        sequenceDjSet(songTable, kdTree, setpointSong, options.topK, options.maxBpmJump, order, transitions, stats);
+    }
+    cout << "Sequenced " << stats.tracks << " tracks in "
+         << chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() << " ms ("
+         << stats.nodesVisited << " tree nodes visited); mean transition "
+         << (stats.tracks > 0 ? stats.totalDistance / stats.tracks : 0) << ", largest " << stats.maxDistance << endl;
+    if (stats.stoppedByBpm)
+    {
+        cout << "Set ended early: no unused song within " << options.maxBpmJump << " bpm of the last track" << endl;
+    }
+
+    cout << "Creating playlist..." << endl;
+    PhaseTimer timer(runStats, "print");
+    writePlaylistOutput(options, [&](ostream &out) {
+        runStats.bytesWritten += print_playlist(songTable, songTable.size(), order, transitions, out, options.format);
+    });
+    cout << "Playlist complete!" << endl;
+    return 0;
+}
+
+int runTablePlaylist(const vector<string> &csvFiles, const PlaylistOptions &options, RunStats &stats)
+{
+/**
+ * @brief Builds the playlist from a column-oriented SongTable instead of vector<Song>.
+ * Scoring uses the batched kernel and sorting works on row indices; only the printed rows
+ * touch text storage.
+ *
+ * @param csvFiles - CSV files that make up the catalog
+ * @param options - command line options
+ * @param stats - receives the phase times and counters
+ * @return process exit code
+ */
+    stats.mode = "table";
+    SongTable songTable;
+    if (!loadSongTable(csvFiles, options, songTable, stats))
+    {
+        return 1;
+    }
+
+    // index titles once so every lookup is a hash probe
+    TitleIndex titleIndex;
+    {
+        PhaseTimer timer(stats, "index");
+        titleIndex.build(songTable);
+    }
+
+    Song setpointSong;
+    getSetpointSong(songTable, titleIndex, setpointSong);
+
+    WeightedScorer scorer(songTable, options.scoreConfig);
+    if (!options.filter.empty() && (options.sequence || options.tune))
+    {
+        cerr << "--filter is ignored by --sequence and --tune" << endl;
+    }
+    if (options.sequence)
+    {
+        if (!scorer.isExact())
+        {
+            cerr << "--weights and --normalize are ignored by --sequence: the chain uses the plain dj_score" << endl;
+        }
+        return runDjSet(songTable, setpointSong, options, stats);
+    }
+    if (options.tune && scorer.isExact())
+    {
+        IncrementalRanker ranker(songTable);
+        if (runTuningSession(songTable, setpointSong, 10, ranker))
+        {
+            vector<double> scores;
+            vector<uint32_t> order;
+            ranker.playlist(options.topK, order, scores);
+            cout << "Creating playlist..." << endl;
+            stats.mode = "tune";
+            PhaseTimer timer(stats, "print");
+            writePlaylistOutput(options, [&](ostream &out) {
+                stats.bytesWritten += print_playlist(songTable, songTable.size(), order, scores, out, options.format);
+            });
+            cout << "Playlist complete!" << endl;
+            return 0;
+        }
+    }
+    if (options.tune)
+    {
+        cerr << "--tune ignored: incremental re-ranking needs the default weights and feature ranges"
+             << " whose squared distances fit in 32 bits" << endl;
+    }
+    const bool filtered = !options.filter.empty();
+    RowBitmap filterRows;
+    if (filtered)
+    {
+        PhaseTimer timer(stats, "filter");
+        if (!applyFilter(songTable, options, filterRows))
+        {
+            return 1;
+        }
+    }
+    // the playlist header counts the songs ranked, i.e. the rows that survived the filter
+    const size_t sourceSongs = filtered ? filterRows.count() : songTable.size();
+    const bool useKdTree = useKdTreeFor(scorer, options);
+    KdTree kdTree;
+    if (useKdTree)
+    {
+        PhaseTimer timer(stats, "index");
+        auto buildStart = chrono::steady_clock::now();
+        kdTree.build(songTable);
+        cout << "k-d tree built in "
+             << chrono::duration<double, milli>(chrono::steady_clock::now() - buildStart).count() << " ms" << endl;
+    }
+    const bool useIvf = useIvfFor(scorer, options);
+    IvfPqIndex ivfIndex;
+    if (useIvf)
+    {
+        PhaseTimer timer(stats, "index");
+        buildIvfIndex(songTable, options, ivfIndex);
+    }
+    const bool useEarlyAbandon = useEarlyAbandonFor(scorer, options, useKdTree || useIvf);
+    EarlyAbandonScorer earlyAbandon;
+    if (useEarlyAbandon)
+    {
+        PhaseTimer timer(stats, "index");
+        earlyAbandon.build(songTable);
+    }
+
+    vector<double> scores;
+    vector<uint32_t> order;
+    // rankSongTable sorts or selects by comparison unless an index answers the query
+    stats.comparisonsCounted = stats.enabled() && !useKdTree && (filtered || (!useIvf && !useEarlyAbandon));
+    auto rankStart = chrono::steady_clock::now();
+    {
+        PhaseTimer timer(stats, "rank");
+        rankSongTable(songTable, scorer, useKdTree ? &kdTree : nullptr, useIvf ? &ivfIndex : nullptr,
+                      filtered ? &filterRows : nullptr, setpointSong, options.topK, scores, order,
+                      options.radix ? max(1u, options.threads) : 0, useEarlyAbandon ? &earlyAbandon : nullptr,
+                      stats.comparisonsCounted ? &stats.comparisons : nullptr);
+    }
+    cout << "Ranked " << order.size() << " songs in "
+         << chrono::duration<double, milli>(chrono::steady_clock::now() - rankStart).count() << " ms" << endl;
+    if (useEarlyAbandon)
+    {
+        stats.featuresPerSong = earlyAbandon.totals().featuresPerSong();
+        cout << "Early abandon: " << stats.featuresPerSong << " of " << SCORE_FEATURES
+             << " features summed per song on average" << endl;
+    }
+
+    cout << "Creating playlist..." << endl;
+    PhaseTimer timer(stats, "print");
+    writePlaylistOutput(options, [&](ostream &out) {
+        stats.bytesWritten += print_playlist(songTable, sourceSongs, order, scores, out, options.format);
+    });
+    cout << "Playlist complete!" << endl;
+    return 0;
+}
+
+/**
+ * @brief One line of a batch seed file: "title" or "title<TAB>artist"
+ *
+ */
+struct BatchSeed
+{
+    string title;
+    string artist;
+};
+
+void readBatchSeeds(istream &in, vector<BatchSeed> &seeds)
+{
+/**
+ * @brief Reads seed titles, one per line, skipping blank lines
+ *
+ * @param in - seed file or stdin
+ * @param seeds - receives the seeds in input order
+ */
+    string line;
+    while (getline(in, line))
+    {
+        if (!line.empty() && line.back() == '\r')
+        {
+            line.pop_back();
+        }
+        if (line.empty())
+        {
+            continue;
+        }
+        BatchSeed seed;
+        size_t tab = line.find('\t');
+        seed.title = line.substr(0, tab);
+        if (tab != string::npos)
+        {
+            seed.artist = line.substr(tab + 1);
+        }
+        seeds.push_back(seed);
+    }
+}
+
+int runBatchPlaylists(const vector<string> &csvFiles, const PlaylistOptions &options, RunStats &stats)
+{
+/**
+ * @brief Answers every seed in options.batchPath against one loaded catalog. Seeds are ranked
+ * in parallel, each worker reusing its own score and order buffers. Playlists go either to
+ * one file per seed in options.outDir, or to a single stream in seed order.
+ *
+ * @param csvFiles - CSV files that make up the catalog
+ * @param options - command line options
+ * @param stats - receives the phase times and counters
+ * @return process exit code
+ */
+    stats.mode = "batch";
+    SongTable songTable;
+    if (!loadSongTable(csvFiles, options, songTable, stats))
+    {
+        return 1;
+    }
+
+    vector<BatchSeed> seeds;
+    if (options.batchPath == "-")
+    {
+        readBatchSeeds(cin, seeds);
+    }
+    else
+    {
+        ifstream seedFile(options.batchPath);
+        if (!seedFile)
+        {
+            cerr << "Could not open " << options.batchPath << endl;
+            return 1;
+        }
+        readBatchSeeds(seedFile, seeds);
+    }
+
+    const bool filtered = !options.filter.empty();
+    RowBitmap filterRows;
+    if (filtered)
+    {
+        PhaseTimer timer(stats, "filter");
+        if (!applyFilter(songTable, options, filterRows))
+        {
+            return 1;
+        }
+    }
+    const size_t sourceSongs = filtered ? filterRows.count() : songTable.size();
+
+    PhaseTimer indexTimer(stats, "index");
+    TitleIndex titleIndex;
+    titleIndex.build(songTable);
+    WeightedScorer scorer(songTable, options.scoreConfig);
+    const bool useKdTree = useKdTreeFor(scorer, options);
+    KdTree kdTree;
+    if (useKdTree)
+    {
+        kdTree.build(songTable);
+    }
+    const bool useIvf = useIvfFor(scorer, options);
+    IvfPqIndex ivfIndex;
+    if (useIvf)
+    {
+        buildIvfIndex(songTable, options, ivfIndex);
+    }
+    const bool useEarlyAbandon = useEarlyAbandonFor(scorer, options, useKdTree || useIvf);
+    EarlyAbandonScorer earlyAbandon;
+    if (useEarlyAbandon)
+    {
+        earlyAbandon.build(songTable);
+    }
+    QueryCache cache(options.cacheBytes);
+    cache.bindCatalog(catalogFingerprint(songTable));
+    const uint64_t params = queryParamsHash(options, useKdTree, useIvf);
+    indexTimer.stop();
+
+    ofstream outFile;
+    ostream *combined = nullptr;
+    if (options.outDir.empty())
+    {
+        if (options.outPath == "-")
+        {
+            combined = &cout;
+        }
+        else
+        {
+            outFile.open(options.outPath.empty() ? playlistFileName(options.format) : options.outPath);
+            combined = &outFile;
+        }
+        // one csv header / #EXTM3U for the whole stream; rows carry the seed number instead
+        PlaylistWriter(*combined, options.format).fileHeader(true);
+    }
+    const bool textFormat = options.format == PlaylistFormat::Text;
+
+    // Seeds are processed in blocks so the combined stream can be written in seed order
+    // without holding every rendered playlist in memory
+    const size_t BLOCK = 1024;
+    const unsigned threads = max(1u, options.threads);
+    vector<string> rendered(BLOCK);
+    atomic<size_t> unmatched{0};
+    atomic<size_t> written{0};
+    atomic<uint64_t> comparisons{0};
+    stats.comparisonsCounted = stats.enabled() && !useKdTree && (filtered || (!useIvf && !useEarlyAbandon));
+    PhaseTimer answerTimer(stats, "answer");
+    auto start = chrono::steady_clock::now();
+    for (size_t blockStart = 0; blockStart < seeds.size(); blockStart += BLOCK)
+    {
+        const size_t blockEnd = min(seeds.size(), blockStart + BLOCK);
+        atomic<size_t> next{blockStart};
+        vector<thread> workers;
+        for (unsigned t = 0; t < threads; ++t)
+        {
+            workers.emplace_back([&] {
+                vector<double> scores;
+                vector<uint32_t> order;
+                ostringstream text;
+                uint64_t workerComparisons = 0;
+                for (size_t q = next++; q < blockEnd; q = next++)
+                {
+                    const BatchSeed &seed = seeds[q];
+                    text.str("");
+                    uint32_t row = 0;
+                    bool found = false;
+                    if (seed.artist.empty())
+                    {
+                        TitleMatches matches = titleIndex.find(seed.title);
+                        found = !matches.empty();
+                        row = found ? *matches.begin() : 0;
+                    }
+                    else
+                    {
+                        vector<uint32_t> matches = titleIndex.find(seed.title, seed.artist, [&songTable](size_t i) {
+                            return songTable.text.artist(i);
+                        });
+                        found = !matches.empty();
+                        row = found ? matches.front() : 0;
+                    }
+
+                    if (!found)
+                    {
+                        ++unmatched;
+                        if (textFormat)
+                        {
+                            text << "No match found for " << seed.title << '\n';
+                        }
+                    }
+                    else
+                    {
+                        // popular seeds repeat: answer them from the cache when possible
+                        const QueryKey key{row, options.topK, params};
+                        shared_ptr<const CachedRanking> cached = cache.enabled() ? cache.find(key) : nullptr;
+                        if (cached != nullptr)
+                        {
+                            order = cached->order;
+                            scores.resize(songTable.size());
+                            for (size_t i = 0; i < order.size(); ++i)
+                            {
+                                scores[order[i]] = cached->scores[i];
+                            }
+                        }
+                        else
+                        {
+                            rankSongTable(songTable, scorer, useKdTree ? &kdTree : nullptr,
+                                          useIvf ? &ivfIndex : nullptr, filtered ? &filterRows : nullptr,
+                                          songTable.row(row), options.topK, scores, order,
+                                          options.radix ? 1 : 0, useEarlyAbandon ? &earlyAbandon : nullptr,
+                                          stats.comparisonsCounted ? &workerComparisons : nullptr);
+                            if (cache.enabled())
+                            {
+                                vector<double> playlistScores(order.size());
+                                for (size_t i = 0; i < order.size(); ++i)
+                                {
+                                    playlistScores[i] = scores[order[i]];
+                                }
+                                cache.insert(key, order, move(playlistScores));
+                            }
+                        }
+                        if (textFormat)
+                        {
+                            text << "Seed " << q + 1 << ": " << songTable.text.title(row) << " by "
+                                 << songTable.text.artist(row) << '\n';
+                        }
+                        if (combined != nullptr)
+                        {
+                            print_playlist(songTable, sourceSongs, order, scores, text, options.format,
+                                           static_cast<long long>(q + 1), false);
+                        }
+                        else
+                        {
+                            print_playlist(songTable, sourceSongs, order, scores, text, options.format);
+                        }
+                    }
+
+                    if (combined != nullptr)
+                    {
+                        rendered[q - blockStart] = text.str();
+                        written += rendered[q - blockStart].size();
+                    }
+                    else if (found)
+                    {
+                        string name = playlistFileName(options.format);
+                        name.insert(name.find('.'), "_" + to_string(q + 1));
+                        ofstream seedFile(options.outDir + "/" + name);
+                        string playlist = text.str();
+                        seedFile << playlist;
+                        written += playlist.size();
+                    }
+                }
+                comparisons += workerComparisons;
+            });
+        }
+        for (thread &worker : workers)
+        {
+            worker.join();
+        }
+        if (combined != nullptr)
+        {
+            for (size_t q = blockStart; q < blockEnd; ++q)
+            {
+                *combined << rendered[q - blockStart];
+            }
+        }
+    }
+    if (combined != nullptr)
+    {
+        combined->flush();
+    }
+    answerTimer.stop();
+    stats.bytesWritten += written;
+    stats.comparisons += comparisons;
+    stats.cacheHits += cache.hits();
+    stats.cacheMisses += cache.misses();
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cerr << "Answered " << seeds.size() - unmatched << " of " << seeds.size() << " seeds on " << threads
+         << " threads in " << seconds * 1000 << " ms ("
+         << static_cast<long long>(seconds > 0 ? seeds.size() / seconds : 0) << " playlists/sec)" << endl;
+    if (cache.enabled())
+    {
+        cerr << "Result cache: " << cache.hits() << " hits, " << cache.misses() << " misses, "
+             << cache.entries() << " entries (" << cache.bytes() / 1024 << " KiB), "
+             << cache.evictions() << " evictions" << endl;
+    }
+    if (useEarlyAbandon)
+    {
+        stats.featuresPerSong = earlyAbandon.totals().featuresPerSong();
+        cerr << "Early abandon: " << stats.featuresPerSong << " of " << SCORE_FEATURES
+             << " features summed per song on average" << endl;
+    }
+    return 0;
+}
+
+
+bool findStreamSetpoint(const vector<string> &csvFiles, const string &title, Song &setpointSong)
+{
+/**
+ * @brief Scans the inputs for the first song with the given title (ignoring case and extra
+ * whitespace), stopping as soon as it is found
+ *
+ * @param csvFiles - CSV inputs; must not include stdin
+ * @param title - title to look for
+ * @param setpointSong - receives the song
+ * @return false if no input has the title
+ */
+    const string key = normalizeKey(title);
+    bool found = false;
+    StreamStats scanStats;
+    for (const string &path : csvFiles)
+    {
+        streamCsvRows(path, [&](const SongRowView &row) {
+            if (!found && normalizeKey(row.title) == key)
+            {
+                setpointSong = toSong(row);
+                found = true;
+            }
+        }, scanStats, 1 << 20, &found);
+        if (found)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+int runStreamingPlaylist(const vector<string> &csvFiles, const PlaylistOptions &options, RunStats &stats)
+{
+/**
+ * @brief Ranks the inputs in one sequential pass, holding only the K best songs and one read
+ * chunk in memory
+ *
+ * @param csvFiles - CSV inputs, "-" for stdin
+ * @param options - command line options
+ * @param stats - receives the phase times and counters
+ * @return process exit code
+ */
+    stats.mode = "stream";
+    if (options.topK == 0)
+    {
+        cerr << "--stream needs --top K" << endl;
+        return 1;
+    }
+    if (!options.filter.empty())
+    {
+        cerr << "--filter needs the indexed in-memory catalog and cannot be used with --stream" << endl;
+        return 1;
+    }
+    if (options.dedup != DedupPolicy::None)
+    {
+        cerr << "--dedup needs every row before choosing which copy to keep and cannot be used with --stream"
+             << endl;
+        return 1;
+    }
+
+    Song setpointSong;
+    if (!options.setpointFeatures.empty())
+    {
+        if (!parseSetpointFeatures(options.setpointFeatures, setpointSong))
+        {
+            cerr << "--setpoint needs all " << SONG_FEATURE_COUNT << " features: " << featureNameList(",") << endl;
+            return 1;
+        }
+    }
+    else
+    {
+        if (find(csvFiles.begin(), csvFiles.end(), "-") != csvFiles.end())
+        {
+            cerr << "Streaming from stdin needs --setpoint: the input cannot be scanned for a title first" << endl;
+            return 1;
+        }
+        string title = options.setpointTitle;
+        if (title.empty())
+        {
+            cout << "Enter a song title: ";
+            getline(cin, title);
+        }
+        if (!findStreamSetpoint(csvFiles, title, setpointSong))
+        {
+            cerr << "No match found for " << title << endl;
+            return 1;
+        }
+        cout << setpointSong.title << " by " << setpointSong.artist << " has been set as the playlist starter!" << endl;
+    }
+
+    StreamingTopK topK(setpointSong, options.topK);
+    StreamStats streamStats;
+    PhaseTimer streamTimer(stats, "stream");
+    auto start = chrono::steady_clock::now();
+    for (const string &path : csvFiles)
+    {
+        bool read = streamCsvRows(path, [&](const SongRowView &row) {
+            streamStats.kept += topK.offer(row) ? 1 : 0;
+        }, streamStats);
+        if (!read)
+        {
+            cerr << "Could not read " << path << endl;
+            return 1;
+        }
+    }
+    streamStats.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    streamTimer.stop();
+    stats.rowsParsed += streamStats.rows;
+    stats.parseErrors += streamStats.skipped;
+    cout << "Streamed " << streamStats.rows << " songs (" << streamStats.bytes / 1e6 << " MB, "
+         << streamStats.skipped << " skipped) in " << streamStats.seconds * 1000 << " ms, "
+         << static_cast<long long>(streamStats.seconds > 0 ? streamStats.rows / streamStats.seconds : 0)
+         << " songs/sec; " << streamStats.kept << " heap inserts, " << streamStats.bufferBytes
+         << " byte read buffer" << endl;
+
+    vector<Song> playlist;
+    {
+        PhaseTimer timer(stats, "sort");
+        topK.result(playlist);
+    }
+    cout << "Creating playlist..." << endl;
+    PhaseTimer timer(stats, "print");
+    writePlaylistOutput(options, [&](ostream &out) {
+        stats.bytesWritten += print_playlist(playlist, streamStats.rows, out, options.format);
+    });
+    cout << "Playlist complete!" << endl;
+    return 0;
+}
+
+
+int reportStats(const RunStats &stats, int status)
+{
+/**
+ * @brief Prints the --stats JSON report to stderr, if enabled, and passes status through
+ *
+ * @param stats - phase times and counters of the run
+ * @param status - process exit code
+ */
+    if (stats.enabled())
+    {
+        stats.writeJson(cerr);
+    }
+    return status;
+}
+
+int main(int argc, char *argv[])
+{
+    /**
+     * Command line options:
+     *   --mmap    load the CSVs with the memory-mapped loader instead of readFile
+     *   --table   load into a column-oriented SongTable and rank row indices
+     *   --top K   only rank and print the best K songs
+     *   --dir PATH     load every CSV in a directory (or matching a glob) with the
+     *                  multi-threaded ingest pipeline instead of the three decade files
+     *   --threads N    worker threads for --dir and --batch (default: one per core)
+     *   --kdtree  answer --top K from a k-d tree over the features (implies --table)
+     *   --snapshot PATH    load the catalog from a binary snapshot, rebuilding it from the
+     *                      CSVs when missing or stale (implies --table)
+     *   --verify-snapshot  compare source checksums as well as size and mtime (the default)
+     *   --snapshot-mtime-only  trust a snapshot whose sources match by size and mtime,
+     *                      without rehashing them
+     *   --batch FILE   answer every seed title in FILE ("-" = stdin), one per line as
+     *                  "title" or "title<TAB>artist", without prompting (implies --table)
+     *   --format FMT   playlist layout: text (default), csv, jsonl or m3u
+     *   --out FILE     playlist output, batch playlists in seed order (default playlist.txt,
+     *                  or playlist.csv/.jsonl/.m3u for other formats; "-" = stdout)
+     *   --out-dir DIR  write each batch playlist to DIR/playlist_<n>.<ext> instead
+     *   --weights LIST per-feature weights such as "year=0.5,dur=0" (0 turns a feature off;
+     *                  unlisted features keep weight 1) (implies --table)
+     *   --normalize MODE   none, minmax or zscore: rescale every feature by its range or
+     *                      standard deviation before weighting (implies --table)
+     *   --stream       rank in one sequential pass keeping only the --top K songs, for
+     *                  catalogs larger than memory
+     *   --setpoint F   setpoint features for --stream: one integer per feature in CSV column order, or
+     *                  name=value pairs such as "year=2019,bpm=135,..."
+     *   --title T      setpoint title for --stream instead of prompting
+     *   --input PATH   read this CSV (repeatable; "-" = stdin) instead of the decade files
+     *   --tune         after choosing the setpoint, nudge its features interactively and see
+     *                  the re-ranked playlist after each change (implies --table)
+     *   --sequence     order the playlist as a DJ set: each track is the nearest unused song to
+     *                  the previous one, --top K tracks long (implies --table)
+     *   --max-bpm-jump N   with --sequence, only move to songs within N bpm of the last track
+     *   --ivf          answer --top K approximately from an IVF-PQ index: songs are clustered
+     *                  into inverted lists and stored as product-quantized codes (implies --table)
+     *   --ivf-lists N  inverted lists (default: about the square root of the catalog size)
+     *   --ivf-probes N lists scanned per query (default 8); more probes, better recall
+     *   --pq-bytes N   code bytes per song, 1 to 11 (default 4)
+     *   --ivf-rerank N candidates re-ranked exactly, as a multiple of K (default 8)
+     *   --recall N     with --ivf, print recall@K and latency against the exact ranking over N
+     *                  sample queries for a sweep of probe counts before answering
+     *   --filter EXPR  only rank songs matching EXPR (implies --table): predicates such as
+     *                  genre=dance pop|pop, year=1995..2005, bpm=120..130 or pop=60.., ANDed
+     *                  with ',' and ORed with ';', e.g. "genre=pop,year=2000..;bpm=..90"
+     *   --dedup POLICY collapse songs listed more than once (same title and artist, ignoring
+     *                  case and extra whitespace) while loading, keeping the first copy, the most
+     *                  popular or the latest year: first, popular or latest (default none);
+     *                  loads through the ingest pipeline and bypasses --snapshot
+     *   --radix        order full rankings by an LSD radix sort on packed (score, artist rank)
+     *                  keys instead of comparison sorting (uses --threads workers)
+     *   --early-abandon    answer --top K exactly by summing each song's squared differences
+     *                      in order of decreasing expected size and dropping the song once the
+     *                      sum passes the current K-th best; prints the features summed per
+     *                      song on average (implies --table)
+     *   --cache-mb N   memory budget of the --batch result cache, which answers repeated
+     *                  seeds without re-ranking (default 64; 0 turns it off)
+     *   --stats        print a one-line JSON report to stderr when done: time per phase
+     *                  (load, score, sort, print, ...), rows parsed, parse errors,
+     *                  comparisons, bytes written, features summed per song with
+     *                  --early-abandon and peak RSS
+     */
+    PlaylistOptions options;
+    for (int i = 1; i < argc; ++i)
+    {
+        string arg = argv[i];
+        if (arg == "--mmap")
+        {
+            options.useMmap = true;
+        }
+        else if (arg == "--table")
+        {
+            options.useTable = true;
+        }
+        else if (arg == "--top" && i + 1 < argc)
+        {
+            options.topK = strtoull(argv[++i], nullptr, 10);
+        }
+        else if (arg == "--kdtree")
+        {
+            options.useKdTree = true;
+            options.useTable = true;
+        }
+        else if (arg == "--snapshot" && i + 1 < argc)
+        {
+            options.snapshotPath = argv[++i];
+            options.useTable = true;
+        }
+        else if (arg == "--verify-snapshot")
+        {
+            options.verifySnapshot = true;
+        }
+        else if (arg == "--snapshot-mtime-only")
+        {
+            options.verifySnapshot = false;
+        }
+        else if (arg == "--batch" && i + 1 < argc)
+        {
+            options.batchPath = argv[++i];
+            options.useTable = true;
+        }
+        else if (arg == "--out" && i + 1 < argc)
+        {
+            options.outPath = argv[++i];
+        }
+        else if (arg == "--format" && i + 1 < argc)
+        {
+            if (!parsePlaylistFormat(argv[++i], options.format))
+            {
+                cerr << "Unknown format " << argv[i] << " (expected text, csv, jsonl or m3u)" << endl;
+                return 1;
+            }
+        }
+        else if (arg == "--out-dir" && i + 1 < argc)
+        {
+            options.outDir = argv[++i];
+        }
+        else if (arg == "--weights" && i + 1 < argc)
+        {
+            string error;
+            if (!parseScoreWeights(argv[++i], options.scoreConfig, error))
+            {
+                cerr << error << endl;
+                return 1;
+            }
+            options.useTable = true;
+        }
+        else if (arg == "--normalize" && i + 1 < argc)
+        {
+            if (!parseFeatureScaling(argv[++i], options.scoreConfig.scaling))
+            {
+                cerr << "Unknown normalization " << argv[i] << " (expected none, minmax or zscore)" << endl;
+                return 1;
+            }
+            options.useTable = true;
+        }
+        else if (arg == "--stream")
+        {
+            options.stream = true;
+        }
+        else if (arg == "--setpoint" && i + 1 < argc)
+        {
+            options.setpointFeatures = argv[++i];
+        }
+        else if (arg == "--title" && i + 1 < argc)
+        {
+            options.setpointTitle = argv[++i];
+        }
+        else if (arg == "--sequence")
+        {
+            options.sequence = true;
+            options.useTable = true;
+        }
+        else if (arg == "--max-bpm-jump" && i + 1 < argc)
+        {
+            options.maxBpmJump = atoi(argv[++i]);
+        }
+        else if (arg == "--ivf")
+        {
+            options.useIvf = true;
+            options.useTable = true;
+        }
+        else if (arg == "--ivf-lists" && i + 1 < argc)
+        {
+            options.ivfConfig.lists = strtoull(argv[++i], nullptr, 10);
+        }
+        else if (arg == "--ivf-probes" && i + 1 < argc)
+        {
+            options.ivfConfig.probes = max<size_t>(1, strtoull(argv[++i], nullptr, 10));
+        }
+        else if (arg == "--pq-bytes" && i + 1 < argc)
+        {
+            options.ivfConfig.subspaces = atoi(argv[++i]);
+        }
+        else if (arg == "--ivf-rerank" && i + 1 < argc)
+        {
+            options.ivfConfig.rerank = strtoull(argv[++i], nullptr, 10);
+        }
+        else if (arg == "--recall" && i + 1 < argc)
+        {
+            options.recallQueries = strtoull(argv[++i], nullptr, 10);
+        }
+        else if (arg == "--filter" && i + 1 < argc)
+        {
+            options.filter = argv[++i];
+            options.useTable = true;
+        }
+        else if (arg == "--dedup" && i + 1 < argc)
+        {
+            if (!parseDedupPolicy(argv[++i], options.dedup))
+            {
+                cerr << "Unknown dedup policy " << argv[i] << " (expected none, first, popular or latest)" << endl;
+                return 1;
+            }
+        }
+        else if (arg == "--radix")
+        {
+            options.radix = true;
+        }
+        else if (arg == "--early-abandon")
+        {
+            options.earlyAbandon = true;
+            options.useTable = true;
+        }
+        else if (arg == "--cache-mb" && i + 1 < argc)
+        {
+            options.cacheBytes = static_cast<size_t>(strtoull(argv[++i], nullptr, 10)) << 20;
+        }
+        else if (arg == "--stats")
+        {
+            options.stats = true;
+        }
+        else if (arg == "--tune")
+        {
+            options.tune = true;
+            options.useTable = true;
+        }
+        else if (arg == "--input" && i + 1 < argc)
+        {
+            options.inputs.push_back(argv[++i]);
+        }
+        else if (arg == "--dir" && i + 1 < argc)
+        {
+            options.catalogPath = argv[++i];
+        }
+        else if (arg == "--threads" && i + 1 < argc)
+        {
+            options.threads = static_cast<unsigned>(strtoul(argv[++i], nullptr, 10));
+        }
+        else
+        {
+            cerr << "Unknown option " << arg << endl;
+            return 1;
+        }
+    }
+
+    vector<string> csvFiles = {"1990.csv", "2000.csv", "2010.csv"};
+    if (!options.catalogPath.empty())
+    {
+        csvFiles = listCsvFiles(options.catalogPath);
+        if (csvFiles.empty())
+        {
+            cerr << "No CSV files found in " << options.catalogPath << endl;
+            return 1;
+        }
+    }
+    if (!options.inputs.empty())
+    {
+        csvFiles = options.inputs;
+    }
+    RunStats stats(options.stats);
+    if (options.stream)
+    {
+        return reportStats(stats, runStreamingPlaylist(csvFiles, options, stats));
+    }
+    if (!options.batchPath.empty())
+    {
+        return reportStats(stats, runBatchPlaylists(csvFiles, options, stats));
+    }
+    if (options.useTable)
+    {
+        return reportStats(stats, runTablePlaylist(csvFiles, options, stats));
+    }
+
+    // Create vector of songs
+    vector<Song> songData;
+
+    /**
+     * Read data from each file. Both loaders are timed so their
+     * throughput can be compared with and without --mmap
+     */
+    LoadStats loadStats;
+    PhaseTimer loadTimer(stats, "load");
+    const bool useIngest = !options.catalogPath.empty() || options.dedup != DedupPolicy::None;
+    if (useIngest)
+    {
+        IngestStats ingestStats;
+        SongDeduplicator dedup(options.dedup);
+        bool loaded = ingestCsvFiles(csvFiles, options.threads, [&songData](vector<Song> &&rows) {
+            songData.insert(songData.end(), make_move_iterator(rows.begin()), make_move_iterator(rows.end()));
+        }, ingestStats, options.dedup != DedupPolicy::None ? &dedup : nullptr);
+        printIngestStats(ingestStats, cout);
+        if (!loaded)
+        {
+            cerr << "Could not map every CSV file" << endl;
+            return 1;
+        }
+        loadStats.rows = ingestStats.rows;
+        loadStats.skipped = ingestStats.skipped;
+        loadStats.seconds = ingestStats.wallSeconds;
+    }
+    else if (options.useMmap)
+    {
+        for (const string &path : csvFiles)
+        {
+            if (!readMappedFile(path, songData, loadStats))
+            {
+                cerr << "Could not map " << path << endl;
+                return 1;
+            }
+        }
+    }
+    else
+    {
+        auto loadStart = chrono::steady_clock::now();
+        for (const string &path : csvFiles)
+        {
+            ifstream inFile(path);
+            readFile(inFile, songData, &loadStats.skipped);
+            inFile.close();
+        }
+        loadStats.rows = songData.size();
+        loadStats.seconds = chrono::duration<double>(chrono::steady_clock::now() - loadStart).count();
+    }
+    loadTimer.stop();
+    stats.rowsParsed = loadStats.rows;
+    stats.parseErrors = loadStats.skipped;
+    const char *loader = useIngest ? "ingest" : options.useMmap ? "mmap" : "readFile";
+    cout << "Loaded " << loadStats.rows << " songs with " << loader
+         << " loader in " << loadStats.seconds * 1000 << " ms ("
+         << static_cast<long long>(loadStats.rowsPerSec()) << " rows/sec)" << endl;
+
+    /**
+     * Query user for song title to define song attribute setpoints.
+     * When song is found in vector, output song has been set to start
+     * the playlist, otherwise re-prompt user for song title
+     */
+    TitleIndex titleIndex;
+    {
+        PhaseTimer timer(stats, "index");
+        titleIndex.build(songData);
+    }
+
+    Song setpointSong;
+    getSetpointSong(songData, titleIndex, setpointSong);
+
+    // calculate DJ scores
+    {
+        PhaseTimer timer(stats, "score");
+        for(int i = 0; i < songData.size(); ++i){
+            songData.at(i).dj_score = calcDJScore(songData.at(i), setpointSong);
+        }
+    }
+
+    // Print out your developed playlist!
+    if (options.topK > 0)
+    {
+        // Only the winners are ordered; songData itself is never sorted or copied
+        vector<uint32_t> topK;
+        {
+            PhaseTimer timer(stats, "sort");
+            if (stats.enabled())
+            {
+                selectTopK(songData.size(), options.topK, countComparisons([&songData](uint32_t a, uint32_t b) {
+                    return compareSong(songData[a], songData[b]);
+                }, stats), topK);
+            }
+            else
+            {
+                topKSongs(songData, options.topK, topK);
+            }
+        }
+        cout << "Creating playlist..." << endl;
+        PhaseTimer timer(stats, "print");
+        writePlaylistOutput(options, [&](ostream &out) {
+            stats.bytesWritten += print_playlist(songData, topK, out, options.format);
+        });
+    }
+    else
+    {
+        // Sort your vector!
+        vector<uint32_t> order;
+        {
+            PhaseTimer timer(stats, "sort");
+            if (options.radix)
+            {
+                // rank indices by packed keys; songData itself is never moved
+                radixRankSongs(songData, max(1u, options.threads), order);
+            }
+            else if (stats.enabled())
+            {
+                sort(songData.begin(), songData.end(), countComparisons(compareSong, stats));
+            }
+            else
+            {
+                sort(songData.begin(), songData.end(), compareSong);
+            }
+        }
+
+        cout << "Creating playlist..." << endl;
+        PhaseTimer timer(stats, "print");
+        writePlaylistOutput(options, [&](ostream &out) {
+            stats.bytesWritten += options.radix ? print_playlist(songData, order, out, options.format)
+                                                : print_playlist(songData, songData.size(), out, options.format);
+        });
+    }
+    cout << "Playlist complete!" << endl;
+    return reportStats(stats, 0);
+}
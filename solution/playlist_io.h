@@ -0,0 +1,63 @@
+/**
+ * @file playlist_io.h
+ * @authors Isha Bhatt (ibhatt), Mary Silvio (msilvio), Harsh Jhaveri (hjhaveri)
+ * @brief Reference CSV reader and playlist printer, shared by the playlist generator and the
+ * benchmarks that time them.
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef PLAYLIST_IO_H
+#define PLAYLIST_IO_H
+
+#include <istream>
+#include <iterator>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "song.h"
+#include "csv_mmap.h"
+
+inline void readFile(std::istream &inFile, std::vector<Song> &songData, size_t *skipped = nullptr)
+{
+/**
+ * @brief Function used to read song data into vector. Rows are split by the same structural
+ * index as the other loaders, so quoted fields may hold commas, "" escapes and newlines, and
+ * columns are found by the header's names.
+ *
+ * @param inFile - input file stream, used to read in Song Data
+ * @param songData - vector of all song data
+ * @param skipped - optional counter of malformed rows, which are left out
+ */
+    // Read in the whole file; a quoted field may span lines, so rows are not lines
+    std::string text((std::istreambuf_iterator<char>(inFile)), std::istreambuf_iterator<char>());
+
+    // Add every row to the songData vector, with DJ score set to 0 for now
+    forEachSongRow(text, [&songData](const SongRowView &row) {
+        songData.push_back(toSong(row));
+    }, skipped);
+}
+
+inline void print_playlist(std::vector<Song> & sortedSongData, std::ostream & out)
+{
+/**
+ * @brief Print function used to print songs to the terminal
+ *
+ * @param sortedSongData - vector of all song data
+ * @param out - the output stream where playlist information will be output to
+ */
+    out << "Playlist created using data from " << sortedSongData.size() << " songs!" << std::endl;
+    for(int i = 0; i < sortedSongData.size(); i++)
+    {
+        out << i+1  << " - "
+             << " DJ Score: " << sortedSongData[i].dj_score << std::endl
+             << "\t\t" << sortedSongData[i].title // The \t character is an escape sequence for a tab!
+             << " by " << sortedSongData[i].artist
+             << " from " << sortedSongData[i].year << std::endl;
+    }
+}
+
+#endif // PLAYLIST_IO_H
@@ -0,0 +1,317 @@
+/**
+ * @file playlist_writer.h
+ * @brief Buffered playlist output in several formats.
+ * A PlaylistWriter formats every entry straight into one large buffer with std::to_chars and
+ * hands it to the stream only when the buffer fills and once at the end, so nothing is flushed
+ * per line and no number goes through iostream locale handling. Formats:
+ *   text   the original print_playlist layout, byte for byte
+ *   csv    rank,dj_score,title,artist,genre,year (RFC 4180 quoting)
+ *   jsonl  one JSON object per song
+ *   m3u    extended M3U, one "Artist - Title" entry per song
+ * In csv and jsonl a seed column can be added so several playlists can share one file.
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef PLAYLIST_WRITER_H
+#define PLAYLIST_WRITER_H
+
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+#include "csv_tokenizer.h"
+
+/**
+ * @brief Output layouts a PlaylistWriter can produce
+ *
+ */
+enum class PlaylistFormat
+{
+    Text,
+    Csv,
+    JsonLines,
+    M3U
+};
+
+inline bool parsePlaylistFormat(const std::string &name, PlaylistFormat &format)
+{
+    if (name == "text")
+    {
+        format = PlaylistFormat::Text;
+    }
+    else if (name == "csv")
+    {
+        format = PlaylistFormat::Csv;
+    }
+    else if (name == "jsonl" || name == "json")
+    {
+        format = PlaylistFormat::JsonLines;
+    }
+    else if (name == "m3u")
+    {
+        format = PlaylistFormat::M3U;
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+inline const char *playlistFileName(PlaylistFormat format)
+{
+/**
+ * @brief Default output file for a format
+ *
+ * @param format - output layout
+ */
+    switch (format)
+    {
+    case PlaylistFormat::Csv:
+        return "playlist.csv";
+    case PlaylistFormat::JsonLines:
+        return "playlist.jsonl";
+    case PlaylistFormat::M3U:
+        return "playlist.m3u";
+    default:
+        return "playlist.txt";
+    }
+}
+
+class PlaylistWriter
+{
+public:
+    explicit PlaylistWriter(std::ostream &out, PlaylistFormat format, bool fileHeader = true,
+                            size_t bufferBytes = 1 << 20)
+        : out_(out), format_(format), fileHeaderPending_(fileHeader), bufferBytes_(bufferBytes)
+    {
+    /**
+     * @param out - destination stream
+     * @param format - output layout
+     * @param fileHeader - write the CSV header / #EXTM3U line before the first playlist; turn
+     *                     off when the output is appended to a file that already has one
+     * @param bufferBytes - bytes collected before each write to out
+     */
+        buffer_.reserve(bufferBytes_ + 4096);
+    }
+
+    ~PlaylistWriter() { flush(); }
+
+    PlaylistWriter(const PlaylistWriter &) = delete;
+    PlaylistWriter &operator=(const PlaylistWriter &) = delete;
+
+    void fileHeader(bool withSeed)
+    {
+    /**
+     * @brief Writes the per-file header of the format (only csv and m3u have one)
+     *
+     * @param withSeed - the csv rows will carry a seed column
+     */
+        fileHeaderPending_ = false;
+        if (format_ == PlaylistFormat::Csv)
+        {
+            buffer_ += withSeed ? "seed,rank,dj_score,title,artist,genre,year\n" : "rank,dj_score,title,artist,genre,year\n";
+        }
+        else if (format_ == PlaylistFormat::M3U)
+        {
+            buffer_ += "#EXTM3U\n";
+        }
+    }
+
+    void begin(size_t songs, long long seed = -1)
+    {
+    /**
+     * @brief Starts a playlist
+     *
+     * @param songs - number of entries that will follow
+     * @param seed - added as a seed column to csv and jsonl rows when not negative
+     */
+        if (fileHeaderPending_)
+        {
+            fileHeader(seed >= 0);
+        }
+        seed_ = seed;
+        rank_ = 0;
+        if (format_ == PlaylistFormat::Text)
+        {
+            buffer_ += "Playlist created using data from ";
+            appendInt(songs);
+            buffer_ += " songs!\n";
+        }
+    }
+
+    void song(double score, std::string_view title, std::string_view artist, std::string_view genre,
+              int year, int dur)
+    {
+    /**
+     * @brief Appends the next entry of the playlist
+     *
+     * @param score - dj_score of the song
+     * @param title - song title
+     * @param artist - song artist
+     * @param genre - song genre
+     * @param year - release year
+     * @param dur - duration in seconds
+     */
+        ++rank_;
+        switch (format_)
+        {
+        case PlaylistFormat::Text:
+            appendInt(rank_);
+            buffer_ += " -  DJ Score: ";
+            appendScore(score, 6);
+            buffer_ += "\n\t\t";
+            buffer_ += title;
+            buffer_ += " by ";
+            buffer_ += artist;
+            buffer_ += " from ";
+            appendInt(year);
+            buffer_ += '\n';
+            break;
+        case PlaylistFormat::Csv:
+            if (seed_ >= 0)
+            {
+                appendInt(seed_);
+                buffer_ += ',';
+            }
+            appendInt(rank_);
+            buffer_ += ',';
+            appendScore(score, 0);
+            buffer_ += ',';
+            appendCsv(title);
+            buffer_ += ',';
+            appendCsv(artist);
+            buffer_ += ',';
+            appendCsv(genre);
+            buffer_ += ',';
+            appendInt(year);
+            buffer_ += '\n';
+            break;
+        case PlaylistFormat::JsonLines:
+            buffer_ += '{';
+            if (seed_ >= 0)
+            {
+                buffer_ += "\"seed\":";
+                appendInt(seed_);
+                buffer_ += ',';
+            }
+            buffer_ += "\"rank\":";
+            appendInt(rank_);
+            buffer_ += ",\"dj_score\":";
+            appendScore(score, 0);
+            buffer_ += ",\"title\":";
+            appendJson(title);
+            buffer_ += ",\"artist\":";
+            appendJson(artist);
+            buffer_ += ",\"genre\":";
+            appendJson(genre);
+            buffer_ += ",\"year\":";
+            appendInt(year);
+            buffer_ += "}\n";
+            break;
+        case PlaylistFormat::M3U:
+            buffer_ += "#EXTINF:";
+            appendInt(dur);
+            buffer_ += ',';
+            appendM3uName(artist, title);
+            buffer_ += '\n';
+            appendM3uName(artist, title);
+            buffer_ += ".mp3\n";
+            break;
+        }
+        if (buffer_.size() >= bufferBytes_)
+        {
+            flush();
+        }
+    }
+
+    void flush()
+    {
+    /**
+     * @brief Hands everything buffered so far to the stream (without flushing the stream)
+     */
+        if (!buffer_.empty())
+        {
+            out_.write(buffer_.data(), static_cast<std::streamsize>(buffer_.size()));
+            bytesWritten_ += buffer_.size();
+            buffer_.clear();
+        }
+    }
+
+    // Bytes handed to the stream so far
+    size_t bytesWritten() const { return bytesWritten_; }
+
+private:
+    void appendInt(long long value)
+    {
+        char digits[24];
+        std::to_chars_result result = std::to_chars(digits, digits + sizeof(digits), value);
+        buffer_.append(digits, result.ptr);
+    }
+
+    void appendScore(double score, int precision)
+    {
+    /**
+     * @brief precision 6 matches ostream's default formatting; 0 gives the shortest text that
+     * reads back as the same double
+     */
+        char digits[32];
+        std::to_chars_result result = precision > 0
+            ? std::to_chars(digits, digits + sizeof(digits), score, std::chars_format::general, precision)
+            : std::to_chars(digits, digits + sizeof(digits), score);
+        buffer_.append(digits, result.ptr);
+    }
+
+    void appendCsv(std::string_view text)
+    {
+        appendCsvField(buffer_, text);
+    }
+
+    void appendJson(std::string_view text)
+    {
+        buffer_ += '"';
+        for (char c : text)
+        {
+            if (c == '"' || c == '\\')
+            {
+                buffer_ += '\\';
+                buffer_ += c;
+            }
+            else if (static_cast<unsigned char>(c) < 0x20)
+            {
+                static const char hex[] = "0123456789abcdef";
+                buffer_ += "\\u00";
+                buffer_ += hex[(c >> 4) & 0xF];
+                buffer_ += hex[c & 0xF];
+            }
+            else
+            {
+                buffer_ += c;
+            }
+        }
+        buffer_ += '"';
+    }
+
+    void appendM3uName(std::string_view artist, std::string_view title)
+    {
+        buffer_ += artist;
+        buffer_ += " - ";
+        buffer_ += title;
+    }
+
+    std::ostream &out_;
+    PlaylistFormat format_;
+    bool fileHeaderPending_;
+    size_t bufferBytes_;
+    std::string buffer_;
+    long long seed_ = -1;
+    long long rank_ = 0;
+    size_t bytesWritten_ = 0;
+};
+
+#endif // PLAYLIST_WRITER_H
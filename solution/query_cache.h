@@ -0,0 +1,208 @@
+/**
+ * @file query_cache.h
+ * @brief In-process LRU cache of ranked playlists, for workloads where a few popular seeds
+ * make up most queries. An entry is keyed by the seed row, the playlist length and a hash of
+ * every scoring parameter (weights, normalization, approximate index settings) and holds the
+ * playlist rows with their scores, so a repeated query costs one hash lookup. Entries are
+ * evicted least recently used first to stay within a byte budget, and the whole cache is
+ * dropped when it is bound to a catalog with a different fingerprint.
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef PLAYLIST_QUERY_CACHE_H
+#define PLAYLIST_QUERY_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "song_table.h"
+#include "snapshot.h"
+
+template <typename T>
+uint64_t checksumColumn(const std::vector<T> &column, uint64_t seed)
+{
+    std::string_view bytes(reinterpret_cast<const char *>(column.data()), column.size() * sizeof(T));
+    return checksumBytes(bytes) ^ (seed * 0x9E3779B97F4A7C15ULL);
+}
+
+inline uint64_t catalogFingerprint(const SongTable &table)
+{
+/**
+ * @brief Checksum of every feature column and of the text, so a reloaded catalog with any
+ * changed row gets a different fingerprint
+ *
+ * @param table - loaded catalog
+ */
+    uint64_t hash = table.size();
+    forEachFeature([&](auto k) { hash = checksumColumn(table.column<k>(), hash); });
+    hash = checksumColumn(table.text.artistId, hash);
+    return checksumBytes(table.text.arena) ^ (hash * 0x9E3779B97F4A7C15ULL);
+}
+
+/**
+ * @brief What a cached playlist was computed from
+ *
+ */
+struct QueryKey
+{
+    uint32_t seedRow;   // setpoint row in the catalog
+    uint64_t k;         // playlist length (0 = whole catalog)
+    uint64_t params;    // hash of the scoring parameters
+
+    bool operator==(const QueryKey &other) const
+    {
+        return seedRow == other.seedRow && k == other.k && params == other.params;
+    }
+};
+
+struct QueryKeyHash
+{
+    size_t operator()(const QueryKey &key) const
+    {
+        uint64_t hash = (key.params ^ key.seedRow) * 0x9E3779B97F4A7C15ULL;
+        hash ^= key.k + (hash >> 29);
+        return static_cast<size_t>(hash ^ (hash >> 32));
+    }
+};
+
+/**
+ * @brief A cached playlist: rows in playlist order and the dj_score of each
+ *
+ */
+struct CachedRanking
+{
+    std::vector<uint32_t> order;
+    std::vector<double> scores;     // scores[i] belongs to order[i]
+
+    size_t bytes() const
+    {
+        return sizeof(CachedRanking) + order.capacity() * sizeof(uint32_t) + scores.capacity() * sizeof(double);
+    }
+};
+
+/**
+ * @brief Thread-safe LRU map from QueryKey to CachedRanking with a byte budget
+ *
+ */
+class QueryCache
+{
+public:
+    explicit QueryCache(size_t budgetBytes) : budget_(budgetBytes) {}
+
+    QueryCache(const QueryCache &) = delete;
+    QueryCache &operator=(const QueryCache &) = delete;
+
+    bool enabled() const { return budget_ > 0; }
+
+    void bindCatalog(uint64_t fingerprint)
+    {
+    /**
+     * @brief Ties the cache to a catalog; binding to a different one drops every entry
+     *
+     * @param fingerprint - catalogFingerprint of the loaded catalog
+     */
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (fingerprint != catalog_)
+        {
+            clearLocked();
+            catalog_ = fingerprint;
+        }
+    }
+
+    std::shared_ptr<const CachedRanking> find(const QueryKey &key)
+    {
+    /**
+     * @brief Cached playlist for key, marked most recently used; null on a miss. The entry
+     * stays valid for the caller even if it is evicted meanwhile.
+     *
+     * @param key - query to look up
+     */
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto found = index_.find(key);
+        if (found == index_.end())
+        {
+            ++misses_;
+            return nullptr;
+        }
+        ++hits_;
+        lru_.splice(lru_.begin(), lru_, found->second);
+        return found->second->second;
+    }
+
+    void insert(const QueryKey &key, std::vector<uint32_t> order, std::vector<double> scores)
+    {
+    /**
+     * @brief Caches a playlist, evicting the least recently used entries until the budget
+     * holds. Playlists larger than the whole budget are not cached.
+     *
+     * @param key - query the playlist answers
+     * @param order - playlist rows, best first
+     * @param scores - dj_score of each playlist row, in the same order
+     */
+        auto entry = std::make_shared<CachedRanking>();
+        entry->order = std::move(order);
+        entry->scores = std::move(scores);
+        const size_t cost = entry->bytes() + ENTRY_OVERHEAD;
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (cost > budget_ || index_.count(key) > 0)
+        {
+            return;
+        }
+        while (bytes_ + cost > budget_)
+        {
+            bytes_ -= lru_.back().second->bytes() + ENTRY_OVERHEAD;
+            index_.erase(lru_.back().first);
+            lru_.pop_back();
+            ++evictions_;
+        }
+        lru_.emplace_front(key, std::move(entry));
+        index_.emplace(key, lru_.begin());
+        bytes_ += cost;
+    }
+
+    void clear()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        clearLocked();
+    }
+
+    size_t hits() const { std::lock_guard<std::mutex> lock(mutex_); return hits_; }
+    size_t misses() const { std::lock_guard<std::mutex> lock(mutex_); return misses_; }
+    size_t evictions() const { std::lock_guard<std::mutex> lock(mutex_); return evictions_; }
+    size_t entries() const { std::lock_guard<std::mutex> lock(mutex_); return index_.size(); }
+    size_t bytes() const { std::lock_guard<std::mutex> lock(mutex_); return bytes_; }
+
+private:
+    // list node, hash node and key storage per entry, roughly
+    static constexpr size_t ENTRY_OVERHEAD = 96;
+
+    using Entry = std::pair<QueryKey, std::shared_ptr<const CachedRanking>>;
+
+    void clearLocked()
+    {
+        lru_.clear();
+        index_.clear();
+        bytes_ = 0;
+    }
+
+    mutable std::mutex mutex_;
+    size_t budget_;
+    uint64_t catalog_ = 0;
+    std::list<Entry> lru_;      // most recently used first
+    std::unordered_map<QueryKey, std::list<Entry>::iterator, QueryKeyHash> index_;
+    size_t bytes_ = 0;
+    size_t hits_ = 0;
+    size_t misses_ = 0;
+    size_t evictions_ = 0;
+};
+
+#endif // PLAYLIST_QUERY_CACHE_H
@@ -0,0 +1,269 @@
+/**
+ * @file radix_sort.h
+ * @brief Full-catalog ranking by LSD radix sort on packed 64-bit keys.
+ * Each song's dj_score is quantized to fixed point (the finest resolution that still fits) and
+ * packed above its artist's lexicographic rank, so one unsigned key comparison orders by score,
+ * then artist. (key, row) pairs are then radix sorted one byte at a time, least significant
+ * first, skipping bytes on which every key agrees. Each pass is a counting scatter split across
+ * threads, stable by construction, so songs with equal keys stay in row order: the result is a
+ * single well-defined order however many threads ran.
+ *
+ * Distinct dj_scores under 1000 are square roots of distinct integers and so more than 0.0005
+ * apart, well above the quantization step; within that range the order is compareSong's.
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef PLAYLIST_RADIX_SORT_H
+#define PLAYLIST_RADIX_SORT_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "song.h"
+#include "song_table.h"
+
+/**
+ * @brief Packs (dj_score, artist rank) into one order-preserving 64-bit key
+ *
+ */
+class ScoreKeyPacker
+{
+public:
+    ScoreKeyPacker(double maxScore, size_t artists)
+    {
+    /**
+     * @param maxScore - largest dj_score that will be packed
+     * @param artists - number of distinct artist ranks
+     */
+        artistBits_ = 0;
+        while ((size_t(1) << artistBits_) < std::max<size_t>(artists, 1))
+        {
+            ++artistBits_;
+        }
+        // the largest scaled score must fit in the bits above the artist rank
+        const double limit = std::ldexp(1.0, 64 - artistBits_) - 1;
+        fractionBits_ = 32;
+        while (fractionBits_ > -64 && std::ldexp(std::max(maxScore, 1.0), fractionBits_) >= limit)
+        {
+            --fractionBits_;
+        }
+        scale_ = std::ldexp(1.0, fractionBits_);
+    }
+
+    uint64_t key(double score, uint32_t artistRank) const
+    {
+        return (static_cast<uint64_t>(std::llround(score * scale_)) << artistBits_) | artistRank;
+    }
+
+    // Score resolution of the key: scores closer than this can tie and fall back to artist
+    double step() const { return 1 / scale_; }
+
+private:
+    int artistBits_;
+    int fractionBits_;
+    double scale_;
+};
+
+inline void radixSortPairs(std::vector<uint64_t> &keys, std::vector<uint32_t> &rows, unsigned threads)
+{
+/**
+ * @brief Stable LSD radix sort of (keys[i], rows[i]) pairs by key, ascending
+ *
+ * @param keys - sort keys; sorted on return
+ * @param rows - payload moved along with each key
+ * @param threads - workers per pass (small inputs use one)
+ */
+    const size_t n = keys.size();
+    const size_t RADIX = 256;
+    const int PASSES = 8;
+    threads = std::max(1u, std::min<unsigned>(threads, static_cast<unsigned>(n / 65536 + 1)));
+
+    // one read of the keys builds every pass's histogram, per thread
+    std::vector<size_t> chunkStart(threads + 1);
+    for (unsigned t = 0; t <= threads; ++t)
+    {
+        chunkStart[t] = n * t / threads;
+    }
+    std::vector<size_t> counts(static_cast<size_t>(threads) * PASSES * RADIX, 0);
+    auto parallel = [threads](auto &&work) {
+        if (threads == 1)
+        {
+            work(0u);
+            return;
+        }
+        std::vector<std::thread> workers;
+        for (unsigned t = 0; t < threads; ++t)
+        {
+            workers.emplace_back(work, t);
+        }
+        for (std::thread &worker : workers)
+        {
+            worker.join();
+        }
+    };
+    parallel([&](unsigned t) {
+        size_t *count = &counts[static_cast<size_t>(t) * PASSES * RADIX];
+        for (size_t i = chunkStart[t]; i < chunkStart[t + 1]; ++i)
+        {
+            uint64_t key = keys[i];
+            for (int pass = 0; pass < PASSES; ++pass)
+            {
+                ++count[pass * RADIX + ((key >> (8 * pass)) & 0xFF)];
+            }
+        }
+    });
+
+    std::vector<uint64_t> keyScratch(n);
+    std::vector<uint32_t> rowScratch(n);
+    std::vector<size_t> offset(static_cast<size_t>(threads) * RADIX);
+    bool reordered = false;
+    for (int pass = 0; pass < PASSES; ++pass)
+    {
+        // a pass where every key has the same byte would not move anything; the totals per
+        // digit do not depend on the current order, so the first histogram still answers this
+        bool trivial = false;
+        for (size_t digit = 0; digit < RADIX && !trivial; ++digit)
+        {
+            size_t inDigit = 0;
+            for (unsigned t = 0; t < threads; ++t)
+            {
+                inDigit += counts[(static_cast<size_t>(t) * PASSES + pass) * RADIX + digit];
+            }
+            trivial = inDigit == n;
+        }
+        if (trivial || n == 0)
+        {
+            continue;
+        }
+
+        const int shift = 8 * pass;
+        if (threads > 1 && reordered)
+        {
+            // each thread's share of a digit depends on which keys its chunk now holds
+            parallel([&](unsigned t) {
+                size_t *count = &counts[(static_cast<size_t>(t) * PASSES + pass) * RADIX];
+                std::fill(count, count + RADIX, 0);
+                for (size_t i = chunkStart[t]; i < chunkStart[t + 1]; ++i)
+                {
+                    ++count[(keys[i] >> shift) & 0xFF];
+                }
+            });
+        }
+
+        // thread t writes digit d after all smaller digits and after threads < t's digit d,
+        // which keeps every pass stable
+        size_t total = 0;
+        for (size_t digit = 0; digit < RADIX; ++digit)
+        {
+            for (unsigned t = 0; t < threads; ++t)
+            {
+                offset[t * RADIX + digit] = total;
+                total += counts[(static_cast<size_t>(t) * PASSES + pass) * RADIX + digit];
+            }
+        }
+        parallel([&](unsigned t) {
+            size_t *next = &offset[t * RADIX];
+            for (size_t i = chunkStart[t]; i < chunkStart[t + 1]; ++i)
+            {
+                size_t pos = next[(keys[i] >> shift) & 0xFF]++;
+                keyScratch[pos] = keys[i];
+                rowScratch[pos] = rows[i];
+            }
+        });
+        keys.swap(keyScratch);
+        rows.swap(rowScratch);
+        reordered = true;
+    }
+}
+
+inline void radixRankSongs(const std::vector<Song> &songData, unsigned threads, std::vector<uint32_t> &order)
+{
+/**
+ * @brief Indices of every song, best first, by (quantized dj_score, artist, index)
+ *
+ * @param songData - vector of all song data with dj_score filled in
+ * @param threads - radix sort workers
+ * @param order - receives indices into songData
+ */
+    // artist rank: dedupe with a hash map, then sort only the distinct names
+    std::unordered_map<std::string_view, uint32_t> artistIds;
+    std::vector<std::string_view> artists;
+    std::vector<uint32_t> artistOf(songData.size());
+    double maxScore = 0;
+    for (size_t i = 0; i < songData.size(); ++i)
+    {
+        auto inserted = artistIds.emplace(songData[i].artist, static_cast<uint32_t>(artists.size()));
+        if (inserted.second)
+        {
+            artists.push_back(songData[i].artist);
+        }
+        artistOf[i] = inserted.first->second;
+        maxScore = std::max(maxScore, songData[i].dj_score);
+    }
+    std::vector<uint32_t> byName(artists.size());
+    for (size_t id = 0; id < byName.size(); ++id)
+    {
+        byName[id] = static_cast<uint32_t>(id);
+    }
+    std::sort(byName.begin(), byName.end(), [&](uint32_t a, uint32_t b) { return artists[a] < artists[b]; });
+    std::vector<uint32_t> rank(artists.size());
+    for (size_t r = 0; r < byName.size(); ++r)
+    {
+        rank[byName[r]] = static_cast<uint32_t>(r);
+    }
+
+    ScoreKeyPacker packer(maxScore, artists.size());
+    std::vector<uint64_t> keys(songData.size());
+    order.resize(songData.size());
+    for (size_t i = 0; i < songData.size(); ++i)
+    {
+        keys[i] = packer.key(songData[i].dj_score, rank[artistOf[i]]);
+        order[i] = static_cast<uint32_t>(i);
+    }
+    radixSortPairs(keys, order, threads);
+}
+
+inline bool radixRankRows(const SongTable &table, const std::vector<double> &dist2, unsigned threads,
+                          std::vector<uint32_t> &order)
+{
+/**
+ * @brief Every row, best first, by (quantized dj_score, artist, row). The keys are built
+ * straight from the table's columns: artist ranks are already precomputed.
+ *
+ * @param table - catalog the distances belong to
+ * @param dist2 - squared distance per row
+ * @param threads - radix sort workers
+ * @param order - receives the sorted row indices
+ * @return false (and order untouched) if the table's artists have not been ranked
+ */
+    const StringDictionary &artists = table.text.artists;
+    if (!artists.ranked())
+    {
+        return false;
+    }
+    double maxDist2 = 0;
+    for (double d : dist2)
+    {
+        maxDist2 = std::max(maxDist2, d);
+    }
+    ScoreKeyPacker packer(std::sqrt(maxDist2), artists.size());
+    std::vector<uint64_t> keys(table.size());
+    order.resize(table.size());
+    for (size_t i = 0; i < keys.size(); ++i)
+    {
+        keys[i] = packer.key(std::sqrt(dist2[i]), artists.rank[table.text.artistId[i]]);
+        order[i] = static_cast<uint32_t>(i);
+    }
+    radixSortPairs(keys, order, threads);
+    return true;
+}
+
+#endif // PLAYLIST_RADIX_SORT_H
@@ -0,0 +1,192 @@
+/**
+ * @file run_stats.h
+ * @brief Per-run phase timers and counters, reported as JSON by --stats.
+ * A PhaseTimer reads the monotonic clock when its scope starts and ends and adds the elapsed
+ * time to its phase. Counters are plain integers the caller adds to. When stats are disabled a
+ * timer never reads the clock and comparisons are not counted, so the instrumentation can stay
+ * compiled in: the only cost left is one predictable branch per phase.
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef PLAYLIST_RUN_STATS_H
+#define PLAYLIST_RUN_STATS_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <sys/resource.h>
+
+/**
+ * @brief Phase times and counters of one run
+ *
+ */
+class RunStats
+{
+public:
+    explicit RunStats(bool enabled = false) : enabled_(enabled) {}
+
+    bool enabled() const { return enabled_; }
+
+    std::string mode = "vector";    // which pipeline answered the query
+    uint64_t rowsParsed = 0;        // CSV rows turned into songs
+    uint64_t parseErrors = 0;       // malformed rows that were skipped
+    uint64_t comparisons = 0;       // song comparisons made while ordering the playlist
+    bool comparisonsCounted = false;    // false when the ranking path does not count them
+    uint64_t bytesWritten = 0;      // playlist bytes handed to the output stream
+    uint64_t cacheHits = 0;         // queries answered from the result cache
+    uint64_t cacheMisses = 0;       // queries the result cache could not answer
+    double featuresPerSong = -1;    // squared differences summed per song by --early-abandon (-1 = not used)
+
+    void addPhase(const char *name, double seconds)
+    {
+    /**
+     * @brief Adds time to a phase; phases are reported in the order they first ran
+     *
+     * @param name - phase name, a string literal
+     * @param seconds - elapsed time to add
+     */
+        for (std::pair<const char *, double> &phase : phases_)
+        {
+            if (std::strcmp(phase.first, name) == 0)
+            {
+                phase.second += seconds;
+                return;
+            }
+        }
+        phases_.emplace_back(name, seconds);
+    }
+
+    static long peakRssKiB()
+    {
+    /**
+     * @brief Peak resident set size of the process so far, in KiB (0 if unavailable)
+     */
+        rusage usage;
+        if (getrusage(RUSAGE_SELF, &usage) != 0)
+        {
+            return 0;
+        }
+#ifdef __APPLE__
+        return usage.ru_maxrss / 1024;  // bytes on macOS
+#else
+        return usage.ru_maxrss;
+#endif
+    }
+
+    void writeJson(std::ostream &out) const
+    {
+    /**
+     * @brief One-line JSON report: times in milliseconds, sizes in bytes or KiB as named
+     *
+     * @param out - where the report goes
+     */
+        out << "{\"mode\":\"" << mode << "\",\"phases_ms\":{";
+        double total = 0;
+        for (size_t p = 0; p < phases_.size(); ++p)
+        {
+            out << (p > 0 ? "," : "") << '"' << phases_[p].first << "\":" << phases_[p].second * 1000;
+            total += phases_[p].second;
+        }
+        out << "},\"total_ms\":" << total * 1000 << ",\"counters\":{\"rows_parsed\":" << rowsParsed
+            << ",\"parse_errors\":" << parseErrors << ",\"comparisons\":";
+        if (comparisonsCounted)
+        {
+            out << comparisons;
+        }
+        else
+        {
+            out << "null";
+        }
+        out << ",\"bytes_written\":" << bytesWritten << ",\"cache_hits\":" << cacheHits
+            << ",\"cache_misses\":" << cacheMisses << ",\"features_per_song\":";
+        if (featuresPerSong >= 0)
+        {
+            out << featuresPerSong;
+        }
+        else
+        {
+            out << "null";
+        }
+        out << "},\"peak_rss_kib\":" << peakRssKiB() << "}\n";
+    }
+
+private:
+    bool enabled_;
+    std::vector<std::pair<const char *, double>> phases_;
+};
+
+/**
+ * @brief Adds the time until the end of its scope to a phase of a RunStats, if enabled
+ *
+ */
+class PhaseTimer
+{
+public:
+    PhaseTimer(RunStats &stats, const char *name)
+        : stats_(stats.enabled() ? &stats : nullptr), name_(name)
+    {
+        if (stats_ != nullptr)
+        {
+            start_ = std::chrono::steady_clock::now();
+        }
+    }
+
+    ~PhaseTimer() { stop(); }
+
+    void stop()
+    {
+    /**
+     * @brief Ends the phase before the end of the scope, for phases whose results must
+     * outlive it
+     */
+        if (stats_ != nullptr)
+        {
+            stats_->addPhase(name_, std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count());
+            stats_ = nullptr;
+        }
+    }
+
+    PhaseTimer(const PhaseTimer &) = delete;
+    PhaseTimer &operator=(const PhaseTimer &) = delete;
+
+private:
+    RunStats *stats_;
+    const char *name_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+/**
+ * @brief Wraps a strict ordering so every call is counted; only used when stats are enabled,
+ * so the uncounted path keeps the plain comparator
+ *
+ */
+template <typename Less>
+struct CountingLess
+{
+    Less less;
+    uint64_t *count;
+
+    template <typename A, typename B>
+    bool operator()(const A &a, const B &b) const
+    {
+        ++*count;
+        return less(a, b);
+    }
+};
+
+template <typename Less>
+CountingLess<Less> countComparisons(Less less, RunStats &stats)
+{
+    stats.comparisonsCounted = true;
+    return CountingLess<Less>{less, &stats.comparisons};
+}
+
+#endif // PLAYLIST_RUN_STATS_H
@@ -0,0 +1,244 @@
+/**
+ * @file score_benchmark.cpp
+ * @brief Microbenchmark for the dj_score kernels.
+ * Tiles the decade CSVs up to the requested number of rows, then reports songs/sec for the
+ * reference calcDJScore loop, the column-at-a-time calcDJScores and every BatchScorer path this
+ * CPU supports. Each path's ranking is checked against calcDJScore + compareSong. Weighted
+ * z-score kernels are timed last, specialized and generic masks side by side; they rank by a
+ * different metric, so they have no reference ranking.
+ *
+ * Build: g++ -std=c++17 -O2 score_benchmark.cpp -o score_benchmark
+ * Usage: ./score_benchmark [rows] [csv directory]
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "song.h"
+#include "dj_score.h"
+#include "csv_mmap.h"
+#include "song_table.h"
+#include "score_kernels.h"
+#include "score_weights.h"
+
+using namespace std;
+
+// Each path is timed this many times and the fastest run is reported
+const int REPEATS = 5;
+
+template <typename Fn>
+double bestSeconds(Fn &&run)
+{
+/**
+ * @brief Runs fn REPEATS times and returns the fastest wall time
+ *
+ * @param run - work to time
+ */
+    double best = 1e30;
+    for (int r = 0; r < REPEATS; ++r)
+    {
+        auto start = chrono::steady_clock::now();
+        run();
+        best = min(best, chrono::duration<double>(chrono::steady_clock::now() - start).count());
+    }
+    return best;
+}
+
+template <typename T>
+void accumulateSquaredDiff(const vector<T> &column, int setpoint, vector<int64_t> &acc)
+{
+/**
+ * @brief Adds (setpoint - column[i])^2 to acc[i] for every row. One tight loop per column
+ * that the compiler can vectorize.
+ *
+ * @param column - feature column
+ * @param setpoint - setpoint value for this feature
+ * @param acc - running sum of squares, one entry per row
+ */
+    const size_t n = column.size();
+    const T *src = column.data();
+    int64_t *dst = acc.data();
+    for (size_t i = 0; i < n; ++i)
+    {
+        int64_t diff = setpoint - static_cast<int>(src[i]);
+        dst[i] += diff * diff;
+    }
+}
+
+void calcDJScores(const SongTable &table, const Song &setpointSong, vector<double> &scores)
+{
+/**
+ * @brief Column-at-a-time version of calcDJScore: scores[i] is the dj_score of row i.
+ * Squares are summed exactly in integers, so results are bit-identical to calcDJScore.
+ *
+ * @param table - catalog to score
+ * @param setpointSong - Song object to compare rows to
+ * @param scores - receives one score per row
+ */
+    vector<int64_t> acc(table.size(), 0);
+    forEachFeature([&](auto k) { accumulateSquaredDiff(table.column<k>(), feature<k>(setpointSong), acc); });
+
+    scores.resize(table.size());
+    for (size_t i = 0; i < acc.size(); ++i)
+    {
+        scores[i] = sqrt(static_cast<double>(acc[i]));
+    }
+}
+
+void sortRows(const SongTable &table, const vector<double> &scores, vector<uint32_t> &order)
+{
+/**
+ * @brief Fills order with every row index sorted the same way compareSong sorts songs:
+ * ascending dj_score, with scores within 0.0005 ordered by artist name.
+ *
+ * @param table - catalog the scores belong to
+ * @param scores - dj_score per row
+ * @param order - receives the sorted row indices
+ */
+    order.resize(table.size());
+    for (size_t i = 0; i < order.size(); ++i)
+    {
+        order[i] = static_cast<uint32_t>(i);
+    }
+    const SongText &text = table.text;
+    sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+        if (abs(scores[a] - scores[b]) > 0.0005)
+        {
+            return scores[a] < scores[b];
+        }
+        return text.artistLess(a, b);
+    });
+}
+
+void report(const string &name, size_t rows, double seconds, bool rankingMatches)
+{
+    cout << "  " << name << string(name.size() < 14 ? 14 - name.size() : 1, ' ')
+         << seconds * 1000 << " ms  " << static_cast<long long>(rows / seconds) << " songs/sec"
+         << (rankingMatches ? "" : "  RANKING MISMATCH") << endl;
+}
+
+bool sameRanking(const vector<Song> &reference, const SongTable &table, const vector<uint32_t> &order,
+                 const vector<double> &dist2)
+{
+/**
+ * @brief Compares a row ranking with the reference sort. Tiled catalogs contain exact
+ * duplicates, so rankings are compared by (score, artist) at each position, not by row id.
+ *
+ * @param reference - songs sorted with compareSong
+ * @param table - catalog the ranking refers to
+ * @param order - row indices to check
+ * @param dist2 - squared distance per row
+ */
+    if (reference.size() != order.size())
+    {
+        return false;
+    }
+    for (size_t i = 0; i < order.size(); ++i)
+    {
+        if (reference[i].dj_score != sqrt(dist2[order[i]]) || reference[i].artist != table.text.artist(order[i]))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t rows = argc > 1 ? strtoull(argv[1], nullptr, 10) : 1000000;
+    string dir = argc > 2 ? string(argv[2]) + "/" : "";
+
+    vector<Song> sample;
+    LoadStats loadStats;
+    for (const char *name : {"1990.csv", "2000.csv", "2010.csv"})
+    {
+        if (!readMappedFile(dir + name, sample, loadStats))
+        {
+            cerr << "Could not map " << dir + name << endl;
+            return 1;
+        }
+    }
+    if (sample.empty() || rows == 0)
+    {
+        cerr << "No songs to benchmark" << endl;
+        return 1;
+    }
+
+    // Tile the sample up to the requested size
+    vector<Song> songData;
+    SongTable songTable;
+    songData.reserve(rows);
+    songTable.reserve(rows);
+    for (size_t i = 0; i < rows; ++i)
+    {
+        songData.push_back(sample[i % sample.size()]);
+        songTable.append(sample[i % sample.size()]);
+    }
+    const Song &setpointSong = sample[0];
+
+    cout << "Scoring " << rows << " songs against \"" << setpointSong.title << "\"" << endl;
+
+    // Reference: one Song at a time through calcDJScore, then sort with compareSong
+    double seconds = bestSeconds([&] {
+        for (Song &song : songData)
+        {
+            song.dj_score = calcDJScore(song, setpointSong);
+        }
+    });
+    vector<Song> reference = songData;
+    sort(reference.begin(), reference.end(), compareSong);
+    report("calcDJScore", rows, seconds, true);
+
+    vector<double> scores;
+    vector<uint32_t> order;
+    seconds = bestSeconds([&] { calcDJScores(songTable, setpointSong, scores); });
+    sortRows(songTable, scores, order);
+    bool columnMatches = true;
+    for (size_t i = 0; i < order.size() && columnMatches; ++i)
+    {
+        columnMatches = reference[i].dj_score == scores[order[i]]
+            && reference[i].artist == songTable.text.artist(order[i]);
+    }
+    report("calcDJScores", rows, seconds, columnMatches);
+
+    vector<double> dist2;
+    for (ScorePath path : {ScorePath::Scalar, ScorePath::SSE42, ScorePath::AVX2})
+    {
+        if (!scorePathSupported(path))
+        {
+            cout << "  " << scorePathName(path) << " not supported on this CPU" << endl;
+            continue;
+        }
+        BatchScorer scorer(songTable, path);
+        seconds = bestSeconds([&] { scorer.squaredDistances(setpointSong, dist2); });
+        sortRowsBySquaredDistance(songTable, dist2, order);
+        report(string("batch ") + scorePathName(path), rows, seconds, sameRanking(reference, songTable, order, dist2));
+    }
+
+    struct WeightedCase
+    {
+        const char *name;
+        const char *weights;
+    };
+    for (const WeightedCase &weighted : {WeightedCase{"zscore all", ""},
+                                         WeightedCase{"zscore -yr-dur", "year=0,dur=0"},
+                                         WeightedCase{"zscore -pop", "pop=0"}})
+    {
+        ScoreConfig config;
+        string error;
+        parseScoreWeights(weighted.weights, config, error);
+        config.scaling = FeatureScaling::ZScore;
+        WeightedScorer scorer(songTable, config);
+        seconds = bestSeconds([&] { scorer.squaredDistances(setpointSong, dist2); });
+        report(string(weighted.name) + (scorer.isSpecialized() ? "" : " (generic)"), rows, seconds, true);
+    }
+    return 0;
+}
@@ -0,0 +1,385 @@
+/**
+ * @file score_kernels.h
+ * @brief Batched dj_score kernels over a SongTable.
+ * A BatchScorer computes the squared dj_score distance (the sum calcDJScore takes the sqrt of)
+ * for a block of rows at a time. On x86 the AVX2 (8 rows) or SSE4.2 (4 rows) path is picked at
+ * runtime with a scalar fallback everywhere else. The SIMD paths square 32-bit integer
+ * differences, so they are only used when the column ranges prove no row can overflow;
+ * otherwise the scalar path sums in 64 bits. Every path is exact, so ranking by squared
+ * distance gives the same order as ranking by calcDJScore, without any sqrt.
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef PLAYLIST_SCORE_KERNELS_H
+#define PLAYLIST_SCORE_KERNELS_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "song.h"
+#include "song_schema.h"
+#include "song_table.h"
+#include "run_stats.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define PLAYLIST_SCORE_X86 1
+#include <immintrin.h>
+#endif
+
+/**
+ * @brief Code paths a BatchScorer can run
+ *
+ */
+enum class ScorePath
+{
+    Scalar,
+    SSE42,
+    AVX2
+};
+
+inline const char *scorePathName(ScorePath path)
+{
+    switch (path)
+    {
+    case ScorePath::AVX2:
+        return "avx2";
+    case ScorePath::SSE42:
+        return "sse4.2";
+    default:
+        return "scalar";
+    }
+}
+
+inline bool scorePathSupported(ScorePath path)
+{
+/**
+ * @brief Checks whether this CPU can run the given path
+ *
+ * @param path - code path to check
+ */
+#ifdef PLAYLIST_SCORE_X86
+    switch (path)
+    {
+    case ScorePath::AVX2:
+        return __builtin_cpu_supports("avx2");
+    case ScorePath::SSE42:
+        return __builtin_cpu_supports("sse4.2");
+    default:
+        return true;
+    }
+#else
+    return path == ScorePath::Scalar;
+#endif
+}
+
+inline ScorePath bestScorePath()
+{
+    if (scorePathSupported(ScorePath::AVX2))
+    {
+        return ScorePath::AVX2;
+    }
+    if (scorePathSupported(ScorePath::SSE42))
+    {
+        return ScorePath::SSE42;
+    }
+    return ScorePath::Scalar;
+}
+
+// Number of feature columns in a SongTable, in the order the kernels visit them
+const int SCORE_FEATURES = SONG_FEATURE_COUNT;
+
+/**
+ * @brief Setpoint features laid out in kernel column order
+ *
+ */
+struct ScoreSetpoint
+{
+    int value[SCORE_FEATURES];
+
+    explicit ScoreSetpoint(const Song &song)
+    {
+        forEachFeature([&](auto k) { value[k] = feature<k>(song); });
+    }
+
+    ScoreSetpoint(const SongTable &t, size_t i)
+    {
+        forEachFeature([&](auto k) { value[k] = t.column<k>()[i]; });
+    }
+};
+
+inline int64_t squaredDistanceRow(const SongTable &t, const ScoreSetpoint &sp, size_t i)
+{
+/**
+ * @brief Exact squared distance of row i in 64-bit integer arithmetic
+ *
+ * @param t - catalog
+ * @param sp - setpoint
+ * @param i - row index
+ */
+    int64_t sum = 0;
+    forEachFeature([&](auto k) {
+        const int64_t diff = sp.value[k] - t.column<k>()[i];
+        sum += diff * diff;
+    });
+    return sum;
+}
+
+inline void scoreRowsScalar(const SongTable &t, const ScoreSetpoint &sp, size_t begin, size_t end, double *out)
+{
+    for (size_t i = begin; i < end; ++i)
+    {
+        out[i] = static_cast<double>(squaredDistanceRow(t, sp, i));
+    }
+}
+
+#ifdef PLAYLIST_SCORE_X86
+
+// AVX2: widen 8 column values to 8 x int32, subtract from the setpoint and accumulate the square
+
+__attribute__((target("avx2"))) inline __m256i avx2Widen(const int16_t *p)
+{
+    return _mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p)));
+}
+
+__attribute__((target("avx2"))) inline __m256i avx2Widen(const int8_t *p)
+{
+    return _mm256_cvtepi8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(p)));
+}
+
+__attribute__((target("avx2"))) inline __m256i avx2Widen(const uint8_t *p)
+{
+    return _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(p)));
+}
+
+template <typename T>
+__attribute__((target("avx2"))) inline __m256i avx2AddSquare(__m256i acc, const T *column, int setpoint)
+{
+    __m256i diff = _mm256_sub_epi32(_mm256_set1_epi32(setpoint), avx2Widen(column));
+    return _mm256_add_epi32(acc, _mm256_mullo_epi32(diff, diff));
+}
+
+// Features K.. of 8 rows; a recursive template rather than forEachFeature because a lambda
+// would not inherit the target attribute
+template <size_t K = 0>
+__attribute__((target("avx2"))) inline __m256i avx2AddFeatures(__m256i acc, const SongTable &t,
+                                                               const ScoreSetpoint &sp, size_t i)
+{
+    acc = avx2AddSquare(acc, t.column<K>().data() + i, sp.value[K]);
+    if constexpr (K + 1 < SCORE_FEATURES)
+    {
+        return avx2AddFeatures<K + 1>(acc, t, sp, i);
+    }
+    else
+    {
+        return acc;
+    }
+}
+
+__attribute__((target("avx2")))
+inline void scoreRowsAVX2(const SongTable &t, const ScoreSetpoint &sp, size_t begin, size_t end, double *out)
+{
+    size_t i = begin;
+    for (; i + 8 <= end; i += 8)
+    {
+        const __m256i acc = avx2AddFeatures(_mm256_setzero_si256(), t, sp, i);
+        _mm256_storeu_pd(out + i, _mm256_cvtepi32_pd(_mm256_castsi256_si128(acc)));
+        _mm256_storeu_pd(out + i + 4, _mm256_cvtepi32_pd(_mm256_extracti128_si256(acc, 1)));
+    }
+    scoreRowsScalar(t, sp, i, end, out);
+}
+
+// SSE4.2: same scheme, 4 rows per step
+
+__attribute__((target("sse4.2"))) inline __m128i sseWiden(const int16_t *p)
+{
+    return _mm_cvtepi16_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(p)));
+}
+
+__attribute__((target("sse4.2"))) inline __m128i sseWiden(const int8_t *p)
+{
+    int32_t bytes;
+    std::memcpy(&bytes, p, sizeof(bytes));
+    return _mm_cvtepi8_epi32(_mm_cvtsi32_si128(bytes));
+}
+
+__attribute__((target("sse4.2"))) inline __m128i sseWiden(const uint8_t *p)
+{
+    int32_t bytes;
+    std::memcpy(&bytes, p, sizeof(bytes));
+    return _mm_cvtepu8_epi32(_mm_cvtsi32_si128(bytes));
+}
+
+template <typename T>
+__attribute__((target("sse4.2"))) inline __m128i sseAddSquare(__m128i acc, const T *column, int setpoint)
+{
+    __m128i diff = _mm_sub_epi32(_mm_set1_epi32(setpoint), sseWiden(column));
+    return _mm_add_epi32(acc, _mm_mullo_epi32(diff, diff));
+}
+
+template <size_t K = 0>
+__attribute__((target("sse4.2"))) inline __m128i sseAddFeatures(__m128i acc, const SongTable &t,
+                                                                const ScoreSetpoint &sp, size_t i)
+{
+    acc = sseAddSquare(acc, t.column<K>().data() + i, sp.value[K]);
+    if constexpr (K + 1 < SCORE_FEATURES)
+    {
+        return sseAddFeatures<K + 1>(acc, t, sp, i);
+    }
+    else
+    {
+        return acc;
+    }
+}
+
+__attribute__((target("sse4.2")))
+inline void scoreRowsSSE42(const SongTable &t, const ScoreSetpoint &sp, size_t begin, size_t end, double *out)
+{
+    size_t i = begin;
+    for (; i + 4 <= end; i += 4)
+    {
+        const __m128i acc = sseAddFeatures(_mm_setzero_si128(), t, sp, i);
+        _mm_storeu_pd(out + i, _mm_cvtepi32_pd(acc));
+        _mm_storeu_pd(out + i + 2, _mm_cvtepi32_pd(_mm_unpackhi_epi64(acc, acc)));
+    }
+    scoreRowsScalar(t, sp, i, end, out);
+}
+
+#endif // PLAYLIST_SCORE_X86
+
+/**
+ * @brief Scores blocks of SongTable rows against a setpoint with the fastest available kernel.
+ * Column ranges are measured once at construction so every query can cheaply prove that
+ * 32-bit lanes cannot overflow.
+ *
+ */
+class BatchScorer
+{
+public:
+    explicit BatchScorer(const SongTable &table, ScorePath path = bestScorePath())
+        : table_(table), path_(scorePathSupported(path) ? path : ScorePath::Scalar)
+    {
+        forEachFeature([&](auto k) { measureRange(k, table.column<k>()); });
+    }
+
+    ScorePath path() const { return path_; }
+
+    bool fitsInt32(const ScoreSetpoint &sp) const
+    {
+    /**
+     * @brief True if no row's squared distance to sp can exceed INT32_MAX
+     *
+     * @param sp - setpoint for the query
+     */
+        int64_t worst = 0;
+        for (int k = 0; k < SCORE_FEATURES; ++k)
+        {
+            int64_t lo = sp.value[k] - static_cast<int64_t>(min_[k]);
+            int64_t hi = sp.value[k] - static_cast<int64_t>(max_[k]);
+            worst += std::max(lo * lo, hi * hi);
+        }
+        return worst <= std::numeric_limits<int32_t>::max();
+    }
+
+    void scoreBlock(const ScoreSetpoint &sp, size_t begin, size_t end, double *out) const
+    {
+    /**
+     * @brief Writes the squared distance of rows [begin, end) to out[begin..end)
+     *
+     * @param sp - setpoint for the query
+     * @param begin - first row
+     * @param end - one past the last row
+     * @param out - output indexed by row
+     */
+        ScorePath path = fitsInt32(sp) ? path_ : ScorePath::Scalar;
+#ifdef PLAYLIST_SCORE_X86
+        if (path == ScorePath::AVX2)
+        {
+            scoreRowsAVX2(table_, sp, begin, end, out);
+            return;
+        }
+        if (path == ScorePath::SSE42)
+        {
+            scoreRowsSSE42(table_, sp, begin, end, out);
+            return;
+        }
+#endif
+        scoreRowsScalar(table_, sp, begin, end, out);
+    }
+
+    void squaredDistances(const Song &setpointSong, std::vector<double> &dist2) const
+    {
+    /**
+     * @brief Squared dj_score distance of every row. calcDJScore == sqrt(dist2[i]).
+     *
+     * @param setpointSong - Song object to compare rows to
+     * @param dist2 - receives one squared distance per row
+     */
+        dist2.resize(table_.size());
+        scoreBlock(ScoreSetpoint(setpointSong), 0, table_.size(), dist2.data());
+    }
+
+private:
+    template <typename T>
+    void measureRange(int k, const std::vector<T> &column)
+    {
+        min_[k] = 0;
+        max_[k] = 0;
+        if (!column.empty())
+        {
+            auto range = std::minmax_element(column.begin(), column.end());
+            min_[k] = *range.first;
+            max_[k] = *range.second;
+        }
+    }
+
+    const SongTable &table_;
+    ScorePath path_;
+    int min_[SCORE_FEATURES];
+    int max_[SCORE_FEATURES];
+};
+
+inline void sortRowsBySquaredDistance(const SongTable &table, const std::vector<double> &dist2,
+                                      std::vector<uint32_t> &order, uint64_t *comparisons = nullptr)
+{
+/**
+ * @brief Ranks rows by squared distance, then artist. Square roots of distinct integers below
+ * 10^6 are more than 0.0005 apart, so for any dj_score under 1000 this is exactly the order
+ * compareSong produces.
+ *
+ * @param table - catalog the distances belong to
+ * @param dist2 - squared distance per row
+ * @param order - receives the sorted row indices
+ * @param comparisons - if not null, every comparison is added to it
+ */
+    order.resize(table.size());
+    for (size_t i = 0; i < order.size(); ++i)
+    {
+        order[i] = static_cast<uint32_t>(i);
+    }
+    const SongText &text = table.text;
+    auto closer = [&](uint32_t a, uint32_t b) {
+        if (dist2[a] != dist2[b])
+        {
+            return dist2[a] < dist2[b];
+        }
+        return text.artistLess(a, b);
+    };
+    if (comparisons != nullptr)
+    {
+        std::sort(order.begin(), order.end(), CountingLess<decltype(closer)>{closer, comparisons});
+    }
+    else
+    {
+        std::sort(order.begin(), order.end(), closer);
+    }
+}
+
+#endif // PLAYLIST_SCORE_KERNELS_H
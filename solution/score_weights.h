@@ -0,0 +1,345 @@
+/**
+ * @file score_weights.h
+ * @brief Weighted and normalized dj_score distance.
+ * Every feature gets a weight, and features can be rescaled by their min-max range or their
+ * standard deviation so that dur and year no longer swamp the 0-100 percentages. Because the
+ * distance only looks at differences, both normalizations reduce to dividing each squared
+ * difference by a per-feature constant: (a - mu) / s - (b - mu) / s = (a - b) / s. The
+ * WeightedScorer folds weight and scale into one coefficient per feature when it is built, so
+ * a query is a weighted sum of squares over the raw integer columns.
+ * Kernels are instantiated per feature mask, so a feature with weight 0 is compiled out of the
+ * loop instead of being multiplied by zero. The default configuration (all weights 1, no
+ * normalization) runs the exact integer BatchScorer, so its scores are unchanged.
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef PLAYLIST_SCORE_WEIGHTS_H
+#define PLAYLIST_SCORE_WEIGHTS_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "song.h"
+#include "song_table.h"
+#include "score_kernels.h"
+
+
+// Mask with one bit per feature, bit k for column k
+const unsigned SCORE_ALL_FEATURES = (1u << SCORE_FEATURES) - 1;
+
+/**
+ * @brief How each feature is rescaled before it is weighted
+ *
+ */
+enum class FeatureScaling
+{
+    Raw,        // the dataset's own units, as calcDJScore uses them
+    MinMax,     // divided by the column's max - min
+    ZScore      // divided by the column's standard deviation
+};
+
+/**
+ * @brief Per-feature weights and the normalization applied to every feature
+ *
+ */
+struct ScoreConfig
+{
+    double weight[SCORE_FEATURES];
+    FeatureScaling scaling = FeatureScaling::Raw;
+
+    ScoreConfig() { std::fill(weight, weight + SCORE_FEATURES, 1.0); }
+
+    unsigned featureMask() const
+    {
+        unsigned mask = 0;
+        for (int k = 0; k < SCORE_FEATURES; ++k)
+        {
+            if (weight[k] != 0)
+            {
+                mask |= 1u << k;
+            }
+        }
+        return mask;
+    }
+
+    bool isDefault() const
+    {
+        for (int k = 0; k < SCORE_FEATURES; ++k)
+        {
+            if (weight[k] != 1)
+            {
+                return false;
+            }
+        }
+        return scaling == FeatureScaling::Raw;
+    }
+};
+
+inline bool parseScoreWeights(const std::string &spec, ScoreConfig &config, std::string &error)
+{
+/**
+ * @brief Parses a weight list such as "year=0.5,dur=0,pop=2". Features that are not listed
+ * keep their current weight.
+ *
+ * @param spec - comma-separated name=weight pairs
+ * @param config - weights are updated in place
+ * @param error - describes the first bad entry when false is returned
+ */
+    size_t pos = 0;
+    while (pos <= spec.size())
+    {
+        size_t comma = spec.find(',', pos);
+        std::string entry = spec.substr(pos, comma == std::string::npos ? std::string::npos : comma - pos);
+        pos = comma == std::string::npos ? spec.size() + 1 : comma + 1;
+        if (entry.empty())
+        {
+            continue;
+        }
+
+        size_t eq = entry.find('=');
+        std::string name = entry.substr(0, eq);
+        int k = 0;
+        while (k < SCORE_FEATURES && name != SONG_FEATURES[k].name)
+        {
+            ++k;
+        }
+        if (eq == std::string::npos || k == SCORE_FEATURES)
+        {
+            error = "unknown feature weight \"" + entry + "\"";
+            return false;
+        }
+        const char *value = entry.c_str() + eq + 1;
+        char *valueEnd = nullptr;
+        double weight = std::strtod(value, &valueEnd);
+        if (valueEnd == value || *valueEnd != '\0' || !(weight >= 0) || std::isinf(weight))
+        {
+            error = "bad weight for " + name + ": \"" + std::string(value) + "\"";
+            return false;
+        }
+        config.weight[k] = weight;
+    }
+    return true;
+}
+
+inline bool parseFeatureScaling(const std::string &name, FeatureScaling &scaling)
+{
+    if (name == "none" || name == "raw")
+    {
+        scaling = FeatureScaling::Raw;
+    }
+    else if (name == "minmax")
+    {
+        scaling = FeatureScaling::MinMax;
+    }
+    else if (name == "zscore")
+    {
+        scaling = FeatureScaling::ZScore;
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+template <unsigned Mask, int K, typename T>
+inline void addWeightedSquare(double &sum, const T *column, const ScoreSetpoint &sp,
+                              const double *coeff, size_t i)
+{
+    if constexpr ((Mask & (1u << K)) != 0)
+    {
+        double diff = static_cast<double>(sp.value[K] - static_cast<int>(column[i]));
+        sum += coeff[K] * diff * diff;
+    }
+}
+
+template <unsigned Mask>
+inline void scoreRowsWeighted(const SongTable &t, const ScoreSetpoint &sp, const double *coeff,
+                              size_t begin, size_t end, double *out)
+{
+/**
+ * @brief Weighted squared distance of rows [begin, end). Features outside Mask are never
+ * loaded; the loop body has no branches, so the compiler can vectorize it.
+ *
+ * @param t - catalog
+ * @param sp - setpoint
+ * @param coeff - weight / scale^2 per feature
+ * @param begin - first row
+ * @param end - one past the last row
+ * @param out - output indexed by row
+ */
+    for (size_t i = begin; i < end; ++i)
+    {
+        double sum = 0;
+        forEachFeature([&](auto k) { addWeightedSquare<Mask, k>(sum, t.column<k>().data(), sp, coeff, i); });
+        out[i] = sum;
+    }
+}
+
+template <typename T>
+inline void addWeightedColumn(const T *column, int setpoint, double coeff, size_t begin, size_t end, double *out)
+{
+    for (size_t i = begin; i < end; ++i)
+    {
+        double diff = static_cast<double>(setpoint - static_cast<int>(column[i]));
+        out[i] += coeff * diff * diff;
+    }
+}
+
+inline void scoreRowsWeightedAnyMask(const SongTable &t, const ScoreSetpoint &sp, const double *coeff,
+                                     unsigned mask, size_t begin, size_t end, double *out)
+{
+/**
+ * @brief Fallback for masks without a specialized kernel: one pass per enabled column
+ */
+    std::fill(out + begin, out + end, 0.0);
+    forEachFeature([&](auto k) {
+        if (mask & (1u << k))
+        {
+            addWeightedColumn(t.column<k>().data(), sp.value[k], coeff[k], begin, end, out);
+        }
+    });
+}
+
+// Masks with a specialized kernel: everything, and everything without year and/or dur, the
+// two features users most often switch off
+const unsigned SCORE_MASK_NO_YEAR = SCORE_ALL_FEATURES & ~(1u << featureIndex("year"));
+const unsigned SCORE_MASK_NO_DUR = SCORE_ALL_FEATURES & ~(1u << featureIndex("dur"));
+const unsigned SCORE_MASK_NO_YEAR_DUR = SCORE_MASK_NO_YEAR & SCORE_MASK_NO_DUR;
+
+/**
+ * @brief Scores SongTable rows under a ScoreConfig. Scales and coefficients are computed once
+ * here, at load time; queries only pick up the precomputed kernel and coefficients.
+ *
+ */
+class WeightedScorer
+{
+public:
+    explicit WeightedScorer(const SongTable &table, const ScoreConfig &config = ScoreConfig(),
+                            ScorePath path = bestScorePath())
+        : table_(table), exact_(table, path), config_(config), mask_(config.featureMask())
+    {
+        forEachFeature([&](auto k) { measureScale(k, table.column<k>()); });
+        for (int k = 0; k < SCORE_FEATURES; ++k)
+        {
+            coeff_[k] = config.weight[k] / (scale_[k] * scale_[k]);
+        }
+
+        switch (mask_)
+        {
+        case SCORE_ALL_FEATURES:
+            kernel_ = scoreRowsWeighted<SCORE_ALL_FEATURES>;
+            break;
+        case SCORE_MASK_NO_YEAR:
+            kernel_ = scoreRowsWeighted<SCORE_MASK_NO_YEAR>;
+            break;
+        case SCORE_MASK_NO_DUR:
+            kernel_ = scoreRowsWeighted<SCORE_MASK_NO_DUR>;
+            break;
+        case SCORE_MASK_NO_YEAR_DUR:
+            kernel_ = scoreRowsWeighted<SCORE_MASK_NO_YEAR_DUR>;
+            break;
+        default:
+            kernel_ = nullptr;
+            break;
+        }
+    }
+
+    const ScoreConfig &config() const { return config_; }
+
+    // True when scores are the exact integer dj_score distances
+    bool isExact() const { return config_.isDefault(); }
+
+    // True when a specialized kernel exists for this feature mask
+    bool isSpecialized() const { return isExact() || kernel_ != nullptr; }
+
+    // Divisor applied to feature k's differences (1 for raw features)
+    double scale(int k) const { return scale_[k]; }
+
+    void scoreBlock(const ScoreSetpoint &sp, size_t begin, size_t end, double *out) const
+    {
+    /**
+     * @brief Writes the weighted squared distance of rows [begin, end) to out[begin..end)
+     *
+     * @param sp - setpoint for the query
+     * @param begin - first row
+     * @param end - one past the last row
+     * @param out - output indexed by row
+     */
+        if (isExact())
+        {
+            exact_.scoreBlock(sp, begin, end, out);
+        }
+        else if (kernel_ != nullptr)
+        {
+            kernel_(table_, sp, coeff_, begin, end, out);
+        }
+        else
+        {
+            scoreRowsWeightedAnyMask(table_, sp, coeff_, mask_, begin, end, out);
+        }
+    }
+
+    void squaredDistances(const Song &setpointSong, std::vector<double> &dist2) const
+    {
+    /**
+     * @brief Weighted squared distance of every row. With the default config this is exactly
+     * BatchScorer::squaredDistances.
+     *
+     * @param setpointSong - Song object to compare rows to
+     * @param dist2 - receives one squared distance per row
+     */
+        dist2.resize(table_.size());
+        scoreBlock(ScoreSetpoint(setpointSong), 0, table_.size(), dist2.data());
+    }
+
+private:
+    typedef void (*Kernel)(const SongTable &, const ScoreSetpoint &, const double *, size_t, size_t, double *);
+
+    template <typename T>
+    void measureScale(int k, const std::vector<T> &column)
+    {
+        scale_[k] = 1;
+        if (column.empty() || config_.scaling == FeatureScaling::Raw)
+        {
+            return;
+        }
+        if (config_.scaling == FeatureScaling::MinMax)
+        {
+            auto range = std::minmax_element(column.begin(), column.end());
+            double span = static_cast<double>(*range.second) - static_cast<double>(*range.first);
+            scale_[k] = span > 0 ? span : 1;
+            return;
+        }
+        // Welford's update keeps the variance accurate on long columns
+        double mean = 0;
+        double m2 = 0;
+        size_t n = 0;
+        for (T value : column)
+        {
+            ++n;
+            double delta = value - mean;
+            mean += delta / n;
+            m2 += delta * (value - mean);
+        }
+        double stddev = std::sqrt(m2 / n);
+        scale_[k] = stddev > 0 ? stddev : 1;
+    }
+
+    const SongTable &table_;
+    BatchScorer exact_;
+    ScoreConfig config_;
+    unsigned mask_;
+    Kernel kernel_ = nullptr;
+    double scale_[SCORE_FEATURES];
+    double coeff_[SCORE_FEATURES];
+};
+
+#endif // PLAYLIST_SCORE_WEIGHTS_H
@@ -0,0 +1,409 @@
+/**
+ * @file snapshot.h
+ * @brief Versioned binary snapshot of a SongTable for fast startup.
+ * The snapshot stores every feature column and the interned text of the SongTable (the string
+ * arena, title offsets, artist/genre ids and both dictionaries) as raw arrays, all 8-byte
+ * aligned, so loading is an mmap and a few bulk copies with no text parsing or per-string
+ * allocation. The size, mtime and content checksum of every source CSV are recorded; a
+ * snapshot whose sources no longer match is reported as stale and rebuilt. Checksums are
+ * compared by default, so a CSV edited in place with its size and mtime restored is still
+ * caught; callers that trust mtimes can skip the rehash.
+ *
+ * Layout (native byte order):
+ *   SnapshotHeader
+ *   SnapshotSource[sourceCount], each followed by its path bytes, padded to 8
+ *   one column per song_schema.h feature, in SongTable order, each padded to 8
+ *   uint64 titleOffset[rows], uint32 titleLength[rows], artistId[rows], genreId[rows]
+ *   uint64 artistOffset[artists], uint32 artistLength[artists]
+ *   uint64 genreOffset[genres], uint32 genreLength[genres]
+ *   string arena
+ * each array padded to 8.
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef PLAYLIST_SNAPSHOT_H
+#define PLAYLIST_SNAPSHOT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <sys/stat.h>
+
+#include "song_table.h"
+#include "csv_mmap.h"
+
+const char SNAPSHOT_MAGIC[8] = {'D', 'J', 'S', 'N', 'A', 'P', '\0', '\0'};
+const uint32_t SNAPSHOT_VERSION = 4;
+
+/**
+ * @brief Fixed-size header at offset 0 of a snapshot file
+ *
+ */
+struct SnapshotHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t sourceCount;
+    uint32_t featureCount;      // SONG_FEATURE_COUNT of the writer
+    uint32_t reserved;
+    uint64_t rows;
+    uint64_t fileBytes;
+    uint64_t columnOffset[SONG_FEATURE_COUNT];  // byte offset of each feature column
+    uint64_t artistCount;
+    uint64_t genreCount;
+    uint64_t textOffset[8];     // titleOffset, titleLength, artistId, genreId, artistOffset,
+                                // artistLength, genreOffset, genreLength
+    uint64_t arenaOffset;
+    uint64_t arenaBytes;
+};
+
+/**
+ * @brief Identity of one source CSV at the time the snapshot was written
+ *
+ */
+struct SnapshotSource
+{
+    uint64_t size;
+    int64_t mtimeNs;
+    uint64_t checksum;
+    uint64_t pathBytes;
+};
+
+/**
+ * @brief Result of trying to load a snapshot
+ *
+ */
+enum class SnapshotStatus
+{
+    Loaded,
+    Missing,    // no snapshot file
+    Stale,      // source list, size, mtime or checksum changed
+    Corrupt     // wrong magic/version or truncated
+};
+
+inline const char *snapshotStatusName(SnapshotStatus status)
+{
+    switch (status)
+    {
+    case SnapshotStatus::Loaded:
+        return "loaded";
+    case SnapshotStatus::Missing:
+        return "missing";
+    case SnapshotStatus::Stale:
+        return "stale";
+    default:
+        return "corrupt";
+    }
+}
+
+inline uint64_t checksumBytes(std::string_view data)
+{
+/**
+ * @brief Fast 64-bit content checksum, 8 bytes per step
+ *
+ * @param data - bytes to hash
+ */
+    const uint64_t prime = 0x9E3779B97F4A7C15ULL;
+    uint64_t hash = data.size() * prime;
+    size_t i = 0;
+    for (; i + 8 <= data.size(); i += 8)
+    {
+        uint64_t word;
+        std::memcpy(&word, data.data() + i, sizeof(word));
+        hash = (hash ^ word) * prime;
+        hash ^= hash >> 29;
+    }
+    for (; i < data.size(); ++i)
+    {
+        hash = (hash ^ static_cast<unsigned char>(data[i])) * prime;
+    }
+    return hash ^ (hash >> 32);
+}
+
+inline bool stampSource(const std::string &path, bool withChecksum, SnapshotSource &stamp)
+{
+/**
+ * @brief Records size, mtime and (optionally) checksum of a source CSV
+ *
+ * @param path - CSV file
+ * @param withChecksum - also read and hash the file contents
+ * @param stamp - receives the identity; pathBytes is left untouched
+ * @return false if the file cannot be read
+ */
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0)
+    {
+        return false;
+    }
+    stamp.size = static_cast<uint64_t>(st.st_size);
+    stamp.mtimeNs = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000LL + st.st_mtim.tv_nsec;
+    stamp.checksum = 0;
+    if (withChecksum)
+    {
+        MappedFile file;
+        if (!file.open(path))
+        {
+            return false;
+        }
+        stamp.checksum = checksumBytes(file.view());
+    }
+    return true;
+}
+
+namespace snapshot_detail
+{
+inline uint64_t align8(uint64_t offset)
+{
+    return (offset + 7) & ~uint64_t(7);
+}
+
+inline void pad(std::ofstream &out, uint64_t &offset)
+{
+    static const char zeros[8] = {};
+    uint64_t aligned = align8(offset);
+    out.write(zeros, static_cast<std::streamsize>(aligned - offset));
+    offset = aligned;
+}
+
+template <typename T>
+void writeColumn(std::ofstream &out, const std::vector<T> &column, uint64_t &offset, uint64_t &columnOffset)
+{
+    columnOffset = offset;
+    out.write(reinterpret_cast<const char *>(column.data()), static_cast<std::streamsize>(column.size() * sizeof(T)));
+    offset += column.size() * sizeof(T);
+    pad(out, offset);
+}
+
+template <typename T>
+bool readColumn(std::string_view file, uint64_t offset, uint64_t rows, std::vector<T> &column)
+{
+    if (offset > file.size() || rows * sizeof(T) > file.size() - offset)
+    {
+        return false;
+    }
+    const T *first = reinterpret_cast<const T *>(file.data() + offset);
+    column.assign(first, first + rows);
+    return true;
+}
+} // namespace snapshot_detail
+
+inline bool writeSnapshot(const std::string &path, const SongTable &table, const std::vector<std::string> &sources)
+{
+/**
+ * @brief Writes table to path as a snapshot of the given source CSVs. The file is written
+ * next to path and renamed into place, so readers never see a partial snapshot.
+ *
+ * @param path - snapshot file to create or replace
+ * @param table - catalog loaded from sources
+ * @param sources - CSV files the table was loaded from, in load order
+ * @return false if a source could not be stamped or the file could not be written
+ */
+    using namespace snapshot_detail;
+
+    std::vector<SnapshotSource> stamps(sources.size());
+    for (size_t i = 0; i < sources.size(); ++i)
+    {
+        if (!stampSource(sources[i], true, stamps[i]))
+        {
+            return false;
+        }
+        stamps[i].pathBytes = sources[i].size();
+    }
+
+    std::string tmpPath = path + ".tmp";
+    std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+    if (!out)
+    {
+        return false;
+    }
+
+    const uint64_t rows = table.size();
+    SnapshotHeader header = {};
+    std::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.sourceCount = static_cast<uint32_t>(sources.size());
+    header.featureCount = SONG_FEATURE_COUNT;
+    header.rows = rows;
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    uint64_t offset = sizeof(header);
+    pad(out, offset);
+
+    for (size_t i = 0; i < sources.size(); ++i)
+    {
+        out.write(reinterpret_cast<const char *>(&stamps[i]), sizeof(SnapshotSource));
+        out.write(sources[i].data(), static_cast<std::streamsize>(sources[i].size()));
+        offset += sizeof(SnapshotSource) + sources[i].size();
+        pad(out, offset);
+    }
+
+    forEachFeature([&](auto k) { writeColumn(out, table.column<k>(), offset, header.columnOffset[k]); });
+
+    const SongText &text = table.text;
+    header.artistCount = text.artists.size();
+    header.genreCount = text.genres.size();
+    writeColumn(out, text.titleOffset, offset, header.textOffset[0]);
+    writeColumn(out, text.titleLength, offset, header.textOffset[1]);
+    writeColumn(out, text.artistId, offset, header.textOffset[2]);
+    writeColumn(out, text.genreId, offset, header.textOffset[3]);
+    writeColumn(out, text.artists.offset, offset, header.textOffset[4]);
+    writeColumn(out, text.artists.length, offset, header.textOffset[5]);
+    writeColumn(out, text.genres.offset, offset, header.textOffset[6]);
+    writeColumn(out, text.genres.length, offset, header.textOffset[7]);
+
+    header.arenaOffset = offset;
+    header.arenaBytes = text.arena.size();
+    out.write(text.arena.data(), static_cast<std::streamsize>(text.arena.size()));
+    offset += text.arena.size();
+    header.fileBytes = offset;
+
+    // Rewrite the header now that every offset is known
+    out.seekp(0);
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    out.close();
+    if (!out)
+    {
+        std::remove(tmpPath.c_str());
+        return false;
+    }
+    return std::rename(tmpPath.c_str(), path.c_str()) == 0;
+}
+
+inline SnapshotStatus loadSnapshot(const std::string &path, const std::vector<std::string> &sources,
+                                   bool verifyChecksums, SongTable &table)
+{
+/**
+ * @brief Loads a snapshot into table if it is still valid for sources
+ *
+ * @param path - snapshot file
+ * @param sources - CSV files the catalog should be built from, in load order
+ * @param verifyChecksums - also rehash every source (size and mtime are always compared);
+ *                          false only for callers that trust mtimes
+ * @param table - receives the catalog; left unchanged unless Loaded is returned
+ * @return Loaded, or why the snapshot cannot be used
+ */
+    using namespace snapshot_detail;
+
+    MappedFile file;
+    if (!file.open(path))
+    {
+        return SnapshotStatus::Missing;
+    }
+    std::string_view data = file.view();
+    SnapshotHeader header;
+    if (data.size() < sizeof(header))
+    {
+        return SnapshotStatus::Corrupt;
+    }
+    std::memcpy(&header, data.data(), sizeof(header));
+    if (std::memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0
+        || header.version != SNAPSHOT_VERSION || header.featureCount != SONG_FEATURE_COUNT
+        || header.fileBytes != data.size())
+    {
+        return SnapshotStatus::Corrupt;
+    }
+
+    // Every source must match by path, size and mtime (and checksum unless skipped)
+    if (header.sourceCount != sources.size())
+    {
+        return SnapshotStatus::Stale;
+    }
+    uint64_t offset = align8(sizeof(header));
+    for (size_t i = 0; i < sources.size(); ++i)
+    {
+        SnapshotSource recorded;
+        if (offset + sizeof(recorded) > data.size())
+        {
+            return SnapshotStatus::Corrupt;
+        }
+        std::memcpy(&recorded, data.data() + offset, sizeof(recorded));
+        offset += sizeof(recorded);
+        if (recorded.pathBytes > data.size() - offset)
+        {
+            return SnapshotStatus::Corrupt;
+        }
+        std::string_view recordedPath = data.substr(offset, recorded.pathBytes);
+        offset = align8(offset + recorded.pathBytes);
+
+        SnapshotSource current;
+        if (recordedPath != sources[i] || !stampSource(sources[i], verifyChecksums, current)
+            || current.size != recorded.size || current.mtimeNs != recorded.mtimeNs
+            || (verifyChecksums && current.checksum != recorded.checksum))
+        {
+            return SnapshotStatus::Stale;
+        }
+    }
+
+    const uint64_t rows = header.rows;
+    if (header.arenaOffset > data.size() || header.arenaBytes > data.size() - header.arenaOffset)
+    {
+        return SnapshotStatus::Corrupt;
+    }
+
+    SongTable loaded;
+    bool columnsOk = true;
+    forEachFeature([&](auto k) {
+        columnsOk = columnsOk && readColumn(data, header.columnOffset[k], rows, loaded.column<k>());
+    });
+    if (!columnsOk)
+    {
+        return SnapshotStatus::Corrupt;
+    }
+
+    SongText &text = loaded.text;
+    if (!readColumn(data, header.textOffset[0], rows, text.titleOffset)
+        || !readColumn(data, header.textOffset[1], rows, text.titleLength)
+        || !readColumn(data, header.textOffset[2], rows, text.artistId)
+        || !readColumn(data, header.textOffset[3], rows, text.genreId)
+        || !readColumn(data, header.textOffset[4], header.artistCount, text.artists.offset)
+        || !readColumn(data, header.textOffset[5], header.artistCount, text.artists.length)
+        || !readColumn(data, header.textOffset[6], header.genreCount, text.genres.offset)
+        || !readColumn(data, header.textOffset[7], header.genreCount, text.genres.length))
+    {
+        return SnapshotStatus::Corrupt;
+    }
+    text.arena.assign(data.data() + header.arenaOffset, header.arenaBytes);
+
+    // Every string must lie inside the arena and every id inside its dictionary
+    auto inArena = [&](uint64_t begin, uint32_t length) {
+        return begin <= header.arenaBytes && length <= header.arenaBytes - begin;
+    };
+    for (uint64_t i = 0; i < rows; ++i)
+    {
+        if (!inArena(text.titleOffset[i], text.titleLength[i]) || text.artistId[i] >= header.artistCount
+            || text.genreId[i] >= header.genreCount)
+        {
+            return SnapshotStatus::Corrupt;
+        }
+    }
+    for (uint64_t id = 0; id < header.artistCount; ++id)
+    {
+        if (!inArena(text.artists.offset[id], text.artists.length[id]))
+        {
+            return SnapshotStatus::Corrupt;
+        }
+    }
+    for (uint64_t id = 0; id < header.genreCount; ++id)
+    {
+        if (!inArena(text.genres.offset[id], text.genres.length[id]))
+        {
+            return SnapshotStatus::Corrupt;
+        }
+    }
+    text.artists.rebuildIndex(text.arena);
+    text.genres.rebuildIndex(text.arena);
+    text.rankArtists();
+
+    table = std::move(loaded);
+    return SnapshotStatus::Loaded;
+}
+
+#endif // PLAYLIST_SNAPSHOT_H
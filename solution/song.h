@@ -0,0 +1,67 @@
+/**
+ * @file song.h
+ * @authors Isha Bhatt (ibhatt), Mary Silvio (msilvio), Harsh Jhaveri (hjhaveri)
+ * @brief Song record shared by the playlist generator and its loaders.
+ *
+ * Dataset Source: https://www.kaggle.com/cnic92/spotify-past-decades-songs-50s10s
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef PLAYLIST_SONG_H
+#define PLAYLIST_SONG_H
+
+#include <string>
+#include <string_view>
+
+// DEFINITIONS
+
+/**
+ * @brief Song structure to represent our song attributes in C++
+ * Dataset: https://www.kaggle.com/cnic92/spotify-past-decades-songs-50s10s
+ *
+ */
+struct Song
+{
+    std::string title;
+    std::string artist;
+    std::string genre;
+    int year;               // Release (or Re-Release Year)
+    int bpm;                // Beats Per Minute
+    int nrgy;               // Energy - The energy of a song - the higher the value, the more energetic the song
+    int dnce;               // Danceability - The higher the value, the easier it is to dance to this song
+    int dB;                 // Loudness (dB) - The higher the value, the louder the song
+    int live;               // Liveness - The higher the value, the more likely the song is a live recording
+    int val;                // Valence - the higher the value, the more positive mood for the song.
+    int dur;                // Duration of the song (sec)
+    int acous;              // Acousticness - The higher the value of the more acoustic the song is
+    int spch;               // Spechiness - the higher the value, the more spoken word the song contains
+    int pop;                // Popularity - the higher the value, the more popular the song is
+    double dj_score;        // dj_score - A custom score used to calculate the "fit" of the song to your playlist
+};
+
+/**
+ * @brief One CSV row parsed in place. The string_views point into the CSV text and are only
+ * valid while that text is alive. Numeric fields mirror Song's (see song_schema.h).
+ *
+ */
+struct SongRowView
+{
+    std::string_view title;
+    std::string_view artist;
+    std::string_view genre;
+    int year;
+    int bpm;
+    int nrgy;
+    int dnce;
+    int dB;
+    int live;
+    int val;
+    int dur;
+    int acous;
+    int spch;
+    int pop;
+};
+
+#endif // PLAYLIST_SONG_H
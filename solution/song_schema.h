@@ -0,0 +1,303 @@
+/**
+ * @file song_schema.h
+ * @brief The one list of a song's numeric features. Each entry names the CSV column and points
+ * at the member in Song and in SongRowView. Every feature counts equally in the dj_score;
+ * per-query weights are ScoreConfig's (score_weights.h).
+ * Loading, setpoint copying, the reference dj_score, feature name lists, the SongTable columns
+ * and every kernel and index over them are generated from this table by forEachFeature, which
+ * expands to straight-line code with one step per feature, so adding a column means adding a
+ * member to Song and SongRowView and a line here.
+ *
+ * CSV files are read by header name: CsvColumnMap resolves the position of every column
+ * from a file's header once, so the columns may come in any order.
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef PLAYLIST_SONG_SCHEMA_H
+#define PLAYLIST_SONG_SCHEMA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "song.h"
+
+/**
+ * @brief Integer type of a feature's SongTable column
+ *
+ */
+enum class ColumnWidth
+{
+    Int8,
+    UInt8,
+    Int16
+};
+
+/**
+ * @brief Descriptor of one numeric feature
+ *
+ */
+struct SongFeature
+{
+    const char *name;               // CSV header, and the name --weights, --setpoint and --filter use
+    int Song::*member;
+    int SongRowView::*viewMember;
+    ColumnWidth width;              // narrowest column type that holds the feature's range
+};
+
+// Features in CSV column order, which is also the order of the SongTable kernel columns
+constexpr SongFeature SONG_FEATURES[] = {
+    {"year", &Song::year, &SongRowView::year, ColumnWidth::Int16},
+    {"bpm", &Song::bpm, &SongRowView::bpm, ColumnWidth::Int16},
+    {"nrgy", &Song::nrgy, &SongRowView::nrgy, ColumnWidth::UInt8},
+    {"dnce", &Song::dnce, &SongRowView::dnce, ColumnWidth::UInt8},
+    {"dB", &Song::dB, &SongRowView::dB, ColumnWidth::Int8},
+    {"live", &Song::live, &SongRowView::live, ColumnWidth::UInt8},
+    {"val", &Song::val, &SongRowView::val, ColumnWidth::UInt8},
+    {"dur", &Song::dur, &SongRowView::dur, ColumnWidth::Int16},
+    {"acous", &Song::acous, &SongRowView::acous, ColumnWidth::UInt8},
+    {"spch", &Song::spch, &SongRowView::spch, ColumnWidth::UInt8},
+    {"pop", &Song::pop, &SongRowView::pop, ColumnWidth::UInt8},
+};
+
+constexpr int SONG_FEATURE_COUNT = static_cast<int>(sizeof(SONG_FEATURES) / sizeof(SONG_FEATURES[0]));
+
+template <typename Fn, size_t... K>
+constexpr void forEachFeature(Fn &&fn, std::index_sequence<K...>)
+{
+    (fn(std::integral_constant<size_t, K>{}), ...);
+}
+
+template <typename Fn>
+constexpr void forEachFeature(Fn &&fn)
+{
+/**
+ * @brief Calls fn(std::integral_constant<size_t, K>) for every feature K in order, unrolled:
+ * inside fn, SONG_FEATURES[K] is a constant expression
+ *
+ * @param fn - generic callback
+ */
+    forEachFeature(fn, std::make_index_sequence<SONG_FEATURE_COUNT>{});
+}
+
+template <size_t K>
+int &feature(Song &song) { return song.*SONG_FEATURES[K].member; }
+
+template <size_t K>
+int feature(const Song &song) { return song.*SONG_FEATURES[K].member; }
+
+template <size_t K>
+int &feature(SongRowView &row) { return row.*SONG_FEATURES[K].viewMember; }
+
+template <size_t K>
+int feature(const SongRowView &row) { return row.*SONG_FEATURES[K].viewMember; }
+
+template <typename From, typename To>
+void copyFeatures(const From &from, To &to)
+{
+/**
+ * @brief Copies every feature between Songs and SongRowViews; text and dj_score are untouched
+ *
+ * @param from - source record
+ * @param to - destination record
+ */
+    forEachFeature([&](auto k) { feature<k>(to) = feature<k>(from); });
+}
+
+template <typename A, typename B>
+int64_t squaredFeatureDistance(const A &a, const B &b)
+{
+/**
+ * @brief Exact squared distance between two records' features
+ *
+ * @param a - first record (Song or SongRowView)
+ * @param b - second record (Song or SongRowView)
+ */
+    int64_t sum = 0;
+    forEachFeature([&](auto k) {
+        const int64_t diff = int64_t(feature<k>(a)) - feature<k>(b);
+        sum += diff * diff;
+    });
+    return sum;
+}
+
+constexpr int featureIndex(std::string_view name)
+{
+/**
+ * @brief Index of the feature with this exact name, or -1
+ *
+ * @param name - feature name such as "bpm"
+ */
+    for (int k = 0; k < SONG_FEATURE_COUNT; ++k)
+    {
+        if (name == SONG_FEATURES[k].name)
+        {
+            return k;
+        }
+    }
+    return -1;
+}
+
+inline std::string featureNameList(const char *separator)
+{
+/**
+ * @brief Every feature name in order, joined by separator
+ *
+ * @param separator - text between two names
+ */
+    std::string names;
+    for (int k = 0; k < SONG_FEATURE_COUNT; ++k)
+    {
+        names += k > 0 ? separator : "";
+        names += SONG_FEATURES[k].name;
+    }
+    return names;
+}
+
+inline void splitCsvFields(std::string_view line, std::vector<std::string_view> &fields)
+{
+/**
+ * @brief Splits one CSV line on the commas outside quoted fields. Fields are kept raw.
+ *
+ * @param line - one row, without the line terminator
+ * @param fields - receives the fields
+ */
+    fields.clear();
+    bool quoted = false;
+    size_t start = 0;
+    for (size_t i = 0; i < line.size(); ++i)
+    {
+        if (line[i] == '"')
+        {
+            quoted = !quoted;
+        }
+        else if (line[i] == ',' && !quoted)
+        {
+            fields.push_back(line.substr(start, i - start));
+            start = i + 1;
+        }
+    }
+    fields.push_back(line.substr(start));
+}
+
+/**
+ * @brief Position of each column in the rows of one CSV file
+ *
+ */
+struct CsvColumnMap
+{
+    static constexpr int MAX_COLUMNS = 64;
+
+    int title = 1;
+    int artist = 2;
+    int genre = 3;
+    int feature[SONG_FEATURE_COUNT];
+    int columns = 4 + SONG_FEATURE_COUNT;   // fields every row must have
+
+    CsvColumnMap()
+    {
+    /**
+     * @brief The decade files' layout: id, title, artist, genre, then the features in schema
+     * order
+     */
+        for (int k = 0; k < SONG_FEATURE_COUNT; ++k)
+        {
+            feature[k] = 4 + k;
+        }
+    }
+
+    bool resolve(const std::string_view *names, int count)
+    {
+    /**
+     * @brief Looks every column up by its header name, ignoring ASCII case and surrounding
+     * spaces ("top genre" is accepted for genre). If a column is missing the map is left as it
+     * was, so headerless or differently named files are still read by position.
+     *
+     * @param names - header fields
+     * @param count - number of header fields
+     * @return true if every column was found
+     */
+        if (count > MAX_COLUMNS)
+        {
+            return false;
+        }
+        CsvColumnMap found;
+        found.title = found.artist = found.genre = -1;
+        for (int k = 0; k < SONG_FEATURE_COUNT; ++k)
+        {
+            found.feature[k] = -1;
+        }
+        for (int c = 0; c < count; ++c)
+        {
+            std::string_view name = names[c];
+            if (c == 0 && name.substr(0, 3) == "\xEF\xBB\xBF")
+            {
+                name.remove_prefix(3);
+            }
+            while (!name.empty() && (name.front() == ' ' || name.front() == '"'))
+            {
+                name.remove_prefix(1);
+            }
+            while (!name.empty() && (name.back() == ' ' || name.back() == '"' || name.back() == '\r'))
+            {
+                name.remove_suffix(1);
+            }
+            if (equalsIgnoreCase(name, "title"))
+            {
+                found.title = c;
+            }
+            else if (equalsIgnoreCase(name, "artist"))
+            {
+                found.artist = c;
+            }
+            else if (equalsIgnoreCase(name, "top genre") || equalsIgnoreCase(name, "genre"))
+            {
+                found.genre = c;
+            }
+            for (int k = 0; k < SONG_FEATURE_COUNT; ++k)
+            {
+                if (equalsIgnoreCase(name, SONG_FEATURES[k].name))
+                {
+                    found.feature[k] = c;
+                }
+            }
+        }
+        bool complete = found.title >= 0 && found.artist >= 0 && found.genre >= 0;
+        for (int k = 0; k < SONG_FEATURE_COUNT; ++k)
+        {
+            complete = complete && found.feature[k] >= 0;
+        }
+        if (complete)
+        {
+            found.columns = count;
+            *this = found;
+        }
+        return complete;
+    }
+
+private:
+    static bool equalsIgnoreCase(std::string_view a, std::string_view b)
+    {
+        if (a.size() != b.size())
+        {
+            return false;
+        }
+        for (size_t i = 0; i < a.size(); ++i)
+        {
+            auto lower = [](char c) { return c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c; };
+            if (lower(a[i]) != lower(b[i]))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+#endif // PLAYLIST_SONG_SCHEMA_H
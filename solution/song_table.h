@@ -0,0 +1,157 @@
+/**
+ * @file song_table.h
+ * @brief Structure-of-arrays song catalog.
+ * Each numeric feature lives in its own contiguous column stored in the narrowest integer
+ * type that holds the dataset's range, so a scoring pass only streams the bytes it uses. The
+ * columns are generated from song_schema.h and addressed by feature index with column<K>().
+ * Title, artist and genre are interned into a separate arena (see string_arena.h) that is only
+ * touched when a row is printed; artist tie-breaks compare precomputed ranks. Rows are
+ * addressed by 32-bit index.
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef PLAYLIST_SONG_TABLE_H
+#define PLAYLIST_SONG_TABLE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "song.h"
+#include "song_schema.h"
+#include "csv_mmap.h"
+#include "string_arena.h"
+
+template <size_t K>
+using FeatureColumnType = std::conditional_t<SONG_FEATURES[K].width == ColumnWidth::Int16, int16_t,
+                          std::conditional_t<SONG_FEATURES[K].width == ColumnWidth::Int8, int8_t, uint8_t>>;
+
+template <size_t... K>
+constexpr size_t featureRowBytes(std::index_sequence<K...>)
+{
+    return (sizeof(FeatureColumnType<K>) + ...);
+}
+
+/**
+ * @brief Column-oriented song catalog with one column per feature of song_schema.h, each in
+ * the width the schema gives it: with the decade features, year, bpm and dur fit in 16 bits,
+ * dB is signed 8-bit and the 0-100 percentages are unsigned 8-bit, 14 bytes per song.
+ *
+ */
+class SongTable
+{
+public:
+    SongText text;
+
+    template <size_t K>
+    std::vector<FeatureColumnType<K>> &column() { return std::get<K>(columns_); }
+
+    template <size_t K>
+    const std::vector<FeatureColumnType<K>> &column() const { return std::get<K>(columns_); }
+
+    static constexpr size_t featureBytesPerRow = featureRowBytes(std::make_index_sequence<SONG_FEATURE_COUNT>{});
+
+    size_t size() const { return std::get<0>(columns_).size(); }
+
+    void reserve(size_t rows)
+    {
+        forEachFeature([&](auto k) { column<k>().reserve(rows); });
+        text.reserve(rows);
+    }
+
+    template <typename Row>
+    bool append(const Row &row)
+    {
+    /**
+     * @brief Appends one song. Works with both Song and SongRowView.
+     *
+     * @param row - source of the features and text for the new row
+     * @return false (and nothing is appended) if a feature does not fit its column
+     */
+        bool fit = true;
+        forEachFeature([&](auto k) { fit = fit && fits<FeatureColumnType<k>>(feature<k>(row)); });
+        if (!fit)
+        {
+            return false;
+        }
+        forEachFeature([&](auto k) { column<k>().push_back(static_cast<FeatureColumnType<k>>(feature<k>(row))); });
+        text.append(row.title, row.artist, row.genre);
+        return true;
+    }
+
+    Song row(size_t i) const
+    {
+    /**
+     * @brief Materializes row i as a Song (dj_score is left at 0)
+     *
+     * @param i - row index
+     */
+        Song song;
+        song.title = std::string(text.title(i));
+        song.artist = std::string(text.artist(i));
+        song.genre = std::string(text.genre(i));
+        forEachFeature([&](auto k) { feature<k>(song) = column<k>()[i]; });
+        song.dj_score = 0;
+        return song;
+    }
+
+    size_t featureBytes() const { return size() * featureBytesPerRow; }
+
+private:
+    template <size_t... K>
+    static std::tuple<std::vector<FeatureColumnType<K>>...> makeColumns(std::index_sequence<K...>);
+
+    template <typename T>
+    static bool fits(int value)
+    {
+        return value >= std::numeric_limits<T>::min() && value <= std::numeric_limits<T>::max();
+    }
+
+    decltype(makeColumns(std::make_index_sequence<SONG_FEATURE_COUNT>{})) columns_;
+};
+
+inline bool readMappedTable(const std::string &path, SongTable &table, LoadStats &stats)
+{
+/**
+ * @brief Memory-maps a song CSV and appends its rows straight into a SongTable
+ *
+ * @param path - CSV file to load
+ * @param table - catalog to append to
+ * @param stats - accumulates rows, bytes and time; rows out of column range count as skipped
+ * @return false if the file could not be opened or mapped
+ */
+    auto start = std::chrono::steady_clock::now();
+
+    MappedFile file;
+    if (!file.open(path))
+    {
+        return false;
+    }
+
+    size_t appended = 0;
+    forEachSongRow(file.view(), [&](const SongRowView &row) {
+        if (table.append(row))
+        {
+            ++appended;
+        }
+        else
+        {
+            ++stats.skipped;
+        }
+    }, &stats.skipped);
+
+    table.text.rankArtists();
+    stats.rows += appended;
+    stats.bytes += file.size();
+    stats.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return true;
+}
+
+#endif // PLAYLIST_SONG_TABLE_H
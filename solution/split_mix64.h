@@ -0,0 +1,38 @@
+/**
+ * @file split_mix64.h
+ * @brief Seeded pseudo-random numbers shared by the synthetic catalog generator and the IVF-PQ
+ * index training, both of which must give the same output for the same seed on every platform.
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef PLAYLIST_SPLIT_MIX64_H
+#define PLAYLIST_SPLIT_MIX64_H
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief splitmix64: a small, fast generator whose whole state is one 64-bit word
+ *
+ */
+struct SplitMix64
+{
+    uint64_t state;
+
+    uint64_t next()
+    {
+        uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+
+    // Uniform in [0, 1) with 53 bits of precision
+    double uniform() { return (next() >> 11) * (1.0 / 9007199254740992.0); }
+
+    size_t below(size_t n) { return static_cast<size_t>(uniform() * n); }
+};
+
+#endif // PLAYLIST_SPLIT_MIX64_H
@@ -0,0 +1,255 @@
+/**
+ * @file stream_top_k.h
+ * @brief Single-pass top-K ranking of catalogs that do not fit in memory.
+ * CSV input is read sequentially in fixed-size chunks (a partial last line is carried over to
+ * the next chunk), each row is scored as it is parsed and only the K best songs are kept in a
+ * bounded heap, so peak memory is O(K + chunk) whatever the catalog size. Scores and ordering
+ * are calcDJScore and compareSong exactly. Input can be a file or stdin, so exports can be
+ * piped in straight from a decompressor.
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef PLAYLIST_STREAM_TOP_K_H
+#define PLAYLIST_STREAM_TOP_K_H
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "song.h"
+#include "dj_score.h"
+#include "csv_mmap.h"
+#include "score_weights.h"
+
+/**
+ * @brief Counters for one streaming pass
+ *
+ */
+struct StreamStats
+{
+    size_t rows = 0;
+    size_t skipped = 0;
+    size_t bytes = 0;
+    size_t chunks = 0;
+    size_t kept = 0;            // rows that entered the top-K heap at some point
+    size_t bufferBytes = 0;     // largest read buffer used (grows only for lines longer than a chunk)
+    double seconds = 0;
+};
+
+inline bool parseSetpointFeatures(const std::string &spec, Song &setpointSong)
+{
+/**
+ * @brief Parses a setpoint given as features: either one comma-separated integer per feature
+ * in CSV column order (year,bpm,nrgy,dnce,dB,live,val,dur,acous,spch,pop) or name=value
+ * pairs naming every feature
+ *
+ * @param spec - feature list
+ * @param setpointSong - receives the features; text fields are cleared
+ * @return false if a feature is missing, unknown or not an integer
+ */
+    bool seen[SONG_FEATURE_COUNT] = {};
+    size_t pos = 0;
+    for (int field = 0; pos <= spec.size(); ++field)
+    {
+        size_t comma = spec.find(',', pos);
+        std::string entry = spec.substr(pos, comma == std::string::npos ? std::string::npos : comma - pos);
+        pos = comma == std::string::npos ? spec.size() + 1 : comma + 1;
+
+        int k = field;
+        size_t eq = entry.find('=');
+        if (eq != std::string::npos)
+        {
+            k = featureIndex(std::string_view(entry).substr(0, eq));
+            entry = entry.substr(eq + 1);
+        }
+        if (k < 0 || k >= SONG_FEATURE_COUNT || seen[k])
+        {
+            return false;
+        }
+        char *end = nullptr;
+        long value = std::strtol(entry.c_str(), &end, 10);
+        if (entry.empty() || *end != '\0')
+        {
+            return false;
+        }
+        setpointSong.*SONG_FEATURES[k].member = static_cast<int>(value);
+        seen[k] = true;
+    }
+    for (int k = 0; k < SONG_FEATURE_COUNT; ++k)
+    {
+        if (!seen[k])
+        {
+            return false;
+        }
+    }
+    setpointSong.title.clear();
+    setpointSong.artist.clear();
+    setpointSong.genre.clear();
+    setpointSong.dj_score = 0;
+    return true;
+}
+
+template <typename RowFn>
+bool streamCsvRows(const std::string &path, RowFn &&onRow, StreamStats &stats, size_t chunkBytes = 4 << 20,
+                   const bool *stop = nullptr)
+{
+/**
+ * @brief Reads a song CSV front to back in chunks of whole rows, calling
+ * onRow(const SongRowView &) for every row. Only one chunk is held in memory at a time.
+ *
+ * @param path - CSV file, or "-" for stdin
+ * @param onRow - callback per row; the views are only valid during the call
+ * @param stats - accumulates rows, bytes and chunks
+ * @param chunkBytes - bytes read per step
+ * @param stop - if not null, reading ends after the chunk in which *stop became true
+ * @return false if the file could not be opened or read
+ */
+    int fd = path == "-" ? STDIN_FILENO : open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+#ifdef POSIX_FADV_SEQUENTIAL
+    if (fd != STDIN_FILENO)
+    {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    }
+#endif
+
+    std::vector<char> buffer(std::max<size_t>(chunkBytes, 4096));
+    CsvStructuralIndex rowIndex;
+    CsvColumnMap columns;   // resolved from the header in the first chunk
+    size_t filled = 0;      // bytes in buffer, starting with the carried-over partial line
+    bool first = true;
+    bool ok = true;
+    while (true)
+    {
+        ssize_t got = read(fd, buffer.data() + filled, buffer.size() - filled);
+        if (got < 0)
+        {
+            ok = false;
+            break;
+        }
+        stats.bytes += static_cast<size_t>(got);
+        filled += static_cast<size_t>(got);
+        bool eof = got == 0;
+
+        // Parse every complete row; keep the tail for the next read. A newline inside a quoted
+        // field does not end a row.
+        size_t usable = filled;
+        if (!eof)
+        {
+            usable = rowIndex.lastRowBoundary(std::string_view(buffer.data(), filled));
+            if (usable == 0)
+            {
+                if (filled == buffer.size())
+                {
+                    // One row longer than the whole buffer: grow rather than split it
+                    buffer.resize(buffer.size() * 2);
+                }
+                continue;
+            }
+        }
+        if (usable > 0)
+        {
+            stats.rows += forEachSongRow(std::string_view(buffer.data(), usable), onRow, &stats.skipped, first,
+                                         &columns);
+            first = false;
+            ++stats.chunks;
+        }
+        std::memmove(buffer.data(), buffer.data() + usable, filled - usable);
+        filled -= usable;
+        if (eof || (stop != nullptr && *stop))
+        {
+            break;
+        }
+    }
+    stats.bufferBytes = std::max(stats.bufferBytes, buffer.size());
+    if (fd != STDIN_FILENO)
+    {
+        close(fd);
+    }
+    return ok;
+}
+
+/**
+ * @brief Bounded heap of the K best songs seen so far under compareSong
+ *
+ */
+class StreamingTopK
+{
+public:
+    StreamingTopK(const Song &setpointSong, size_t k)
+        : setpoint_(setpointSong), k_(k)
+    {
+        heap_.reserve(k);
+    }
+
+    bool offer(const SongRowView &row)
+    {
+    /**
+     * @brief Scores a row and keeps it if it is among the K best so far. The score is
+     * computed from the parsed integers; a Song is only built for rows that make the cut.
+     *
+     * @param row - parsed CSV row
+     * @return true if the row was kept
+     */
+        if (k_ == 0)
+        {
+            return false;
+        }
+        // Same value as calcDJScore: every square and the sum are exact in a double
+        double score = std::sqrt(static_cast<double>(squaredFeatureDistance(setpoint_, row)));
+
+        if (heap_.size() == k_ && score - heap_.front().dj_score > 0.0005)
+        {
+            return false;   // clearly worse than the current K-th best; no strings touched
+        }
+        Song song = toSong(row);
+        song.dj_score = score;
+        if (heap_.size() < k_)
+        {
+            heap_.push_back(std::move(song));
+            std::push_heap(heap_.begin(), heap_.end(), compareSong);
+            return true;
+        }
+        if (!compareSong(song, heap_.front()))
+        {
+            return false;
+        }
+        std::pop_heap(heap_.begin(), heap_.end(), compareSong);
+        heap_.back() = std::move(song);
+        std::push_heap(heap_.begin(), heap_.end(), compareSong);
+        return true;
+    }
+
+    void result(std::vector<Song> &sorted) const
+    {
+    /**
+     * @brief The kept songs, best first
+     *
+     * @param sorted - receives at most K songs in compareSong order
+     */
+        sorted = heap_;
+        std::sort_heap(sorted.begin(), sorted.end(), compareSong);
+    }
+
+private:
+    Song setpoint_;
+    size_t k_;
+    std::vector<Song> heap_;    // max-heap under compareSong: front is the current K-th best
+};
+
+#endif // PLAYLIST_STREAM_TOP_K_H
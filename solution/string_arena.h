@@ -0,0 +1,250 @@
+/**
+ * @file string_arena.h
+ * @brief Interned song text: every title, artist and genre byte lives in one contiguous arena.
+ * Titles are stored once per row and referenced by (offset, length). Artists and genres repeat
+ * across thousands of rows, so each distinct value is stored once and rows hold a 32-bit
+ * dictionary id. Once the artists are ranked, ordering two rows by artist is one integer
+ * comparison instead of a string comparison.
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef PLAYLIST_STRING_ARENA_H
+#define PLAYLIST_STRING_ARENA_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+inline uint64_t hashKey(std::string_view key)
+{
+/**
+ * @brief 64-bit FNV-1a hash of a string
+ *
+ * @param key - text to hash
+ */
+    uint64_t hash = 14695981039346656037ULL;
+    for (unsigned char c : key)
+    {
+        hash ^= c;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+/**
+ * @brief Distinct strings stored in an arena, addressed by dense 32-bit ids in first-seen order
+ *
+ */
+class StringDictionary
+{
+public:
+    std::vector<uint64_t> offset;   // arena offset per id
+    std::vector<uint32_t> length;   // byte length per id
+    std::vector<uint32_t> rank;     // lexicographic rank per id, filled by rankIds()
+
+    size_t size() const { return offset.size(); }
+
+    std::string_view name(const std::string &arena, uint32_t id) const
+    {
+        return std::string_view(arena.data() + offset[id], length[id]);
+    }
+
+    uint32_t intern(std::string &arena, std::string_view text)
+    {
+    /**
+     * @brief Id of text, appending it to the arena the first time it is seen
+     *
+     * @param arena - arena the dictionary's strings live in
+     * @param text - string to intern
+     */
+        if ((size() + 1) * 2 > slots_.size())
+        {
+            grow(arena, slots_.empty() ? 64 : slots_.size() * 2);
+        }
+        uint64_t hash = hashKey(text);
+        size_t slot = probe(arena, text, hash);
+        if (slots_[slot] == EMPTY)
+        {
+            slots_[slot] = static_cast<uint32_t>(size());
+            hashes_.push_back(hash);
+            offset.push_back(arena.size());
+            length.push_back(static_cast<uint32_t>(text.size()));
+            arena.append(text.data(), text.size());
+        }
+        return slots_[slot];
+    }
+
+    bool find(const std::string &arena, std::string_view text, uint32_t &id) const
+    {
+    /**
+     * @brief Looks text up without interning it
+     *
+     * @param arena - arena the dictionary's strings live in
+     * @param text - string to look for
+     * @param id - receives its id when found
+     */
+        if (slots_.empty())
+        {
+            return false;
+        }
+        size_t slot = probe(arena, text, hashKey(text));
+        id = slots_[slot];
+        return id != EMPTY;
+    }
+
+    void rebuildIndex(const std::string &arena)
+    {
+    /**
+     * @brief Rebuilds the lookup table after offset and length were filled in directly,
+     * e.g. from a snapshot
+     *
+     * @param arena - arena the dictionary's strings live in
+     */
+        hashes_.resize(size());
+        for (size_t id = 0; id < size(); ++id)
+        {
+            hashes_[id] = hashKey(name(arena, static_cast<uint32_t>(id)));
+        }
+        size_t capacity = 64;
+        while (capacity < (size() + 1) * 2)
+        {
+            capacity *= 2;
+        }
+        grow(arena, capacity);
+    }
+
+    void rankIds(const std::string &arena)
+    {
+    /**
+     * @brief Computes rank so that rank[a] < rank[b] exactly when name(a) < name(b)
+     *
+     * @param arena - arena the dictionary's strings live in
+     */
+        std::vector<uint32_t> ids(size());
+        for (size_t id = 0; id < ids.size(); ++id)
+        {
+            ids[id] = static_cast<uint32_t>(id);
+        }
+        std::sort(ids.begin(), ids.end(), [&](uint32_t a, uint32_t b) {
+            return name(arena, a) < name(arena, b);
+        });
+        rank.resize(size());
+        for (size_t r = 0; r < ids.size(); ++r)
+        {
+            rank[ids[r]] = static_cast<uint32_t>(r);
+        }
+    }
+
+    // True while rank covers every id (interning a new string invalidates it)
+    bool ranked() const { return rank.size() == size(); }
+
+private:
+    static constexpr uint32_t EMPTY = UINT32_MAX;
+
+    size_t probe(const std::string &arena, std::string_view text, uint64_t hash) const
+    {
+        size_t mask = slots_.size() - 1;
+        size_t slot = static_cast<size_t>(hash) & mask;
+        while (slots_[slot] != EMPTY && (hashes_[slots_[slot]] != hash || name(arena, slots_[slot]) != text))
+        {
+            slot = (slot + 1) & mask;
+        }
+        return slot;
+    }
+
+    void grow(const std::string &arena, size_t capacity)
+    {
+        slots_.assign(capacity, EMPTY);
+        for (size_t id = 0; id < size(); ++id)
+        {
+            slots_[probe(arena, name(arena, static_cast<uint32_t>(id)), hashes_[id])] = static_cast<uint32_t>(id);
+        }
+    }
+
+    std::vector<uint32_t> slots_;   // id per slot, EMPTY if unused; power-of-two size
+    std::vector<uint64_t> hashes_;  // hash per id
+};
+
+/**
+ * @brief Text of every row of a SongTable, interned into one arena
+ *
+ */
+class SongText
+{
+public:
+    std::string arena;                  // every title, artist and genre byte
+    std::vector<uint64_t> titleOffset;  // per row
+    std::vector<uint32_t> titleLength;  // per row
+    std::vector<uint32_t> artistId;     // per row, into artists
+    std::vector<uint32_t> genreId;      // per row, into genres
+    StringDictionary artists;
+    StringDictionary genres;
+
+    size_t size() const { return titleOffset.size(); }
+
+    void reserve(size_t rows)
+    {
+        titleOffset.reserve(rows);
+        titleLength.reserve(rows);
+        artistId.reserve(rows);
+        genreId.reserve(rows);
+    }
+
+    void append(std::string_view title, std::string_view artist, std::string_view genre)
+    {
+        titleOffset.push_back(arena.size());
+        titleLength.push_back(static_cast<uint32_t>(title.size()));
+        arena.append(title.data(), title.size());
+        artistId.push_back(artists.intern(arena, artist));
+        genreId.push_back(genres.intern(arena, genre));
+    }
+
+    std::string_view title(size_t row) const
+    {
+        return std::string_view(arena.data() + titleOffset[row], titleLength[row]);
+    }
+
+    std::string_view artist(size_t row) const { return artists.name(arena, artistId[row]); }
+    std::string_view genre(size_t row) const { return genres.name(arena, genreId[row]); }
+
+    // Ranks the artists so artistLess is an integer comparison; call once loading is done
+    void rankArtists() { artists.rankIds(arena); }
+
+    bool artistLess(size_t a, size_t b) const
+    {
+    /**
+     * @brief artist(a) < artist(b), by precomputed rank when the artists have been ranked
+     *
+     * @param a - first row
+     * @param b - second row
+     */
+        uint32_t x = artistId[a];
+        uint32_t y = artistId[b];
+        if (x == y)
+        {
+            return false;
+        }
+        if (artists.ranked())
+        {
+            return artists.rank[x] < artists.rank[y];
+        }
+        return artists.name(arena, x) < artists.name(arena, y);
+    }
+
+    size_t memoryBytes() const
+    {
+    /**
+     * @brief Bytes held by the arena and the per-row and per-id index vectors
+     */
+        return arena.size() + size() * (sizeof(uint64_t) + 3 * sizeof(uint32_t))
+            + artists.size() * (sizeof(uint64_t) * 2 + sizeof(uint32_t) * 3)
+            + genres.size() * (sizeof(uint64_t) * 2 + sizeof(uint32_t) * 3);
+    }
+};
+
+#endif // PLAYLIST_STRING_ARENA_H
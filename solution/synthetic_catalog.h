@@ -0,0 +1,164 @@
+/**
+ * @file synthetic_catalog.h
+ * @brief Deterministic synthetic song catalogs for scale testing.
+ * The generator is fitted to the sample CSVs: each feature is drawn from the sample's own
+ * distribution for that column (inverse CDF over the sorted sample values, interpolating
+ * between neighbours so large catalogs are not limited to the sample's exact values), and
+ * title, artist and genre are drawn from the sample's text. Row i depends only on the seed and
+ * i, so any range of rows can be generated independently and a given (seed, rows) pair always
+ * produces the same bytes. Output uses the sample files' layout: UTF-8 BOM, the same header
+ * and CRLF line endings.
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef PLAYLIST_SYNTHETIC_CATALOG_H
+#define PLAYLIST_SYNTHETIC_CATALOG_H
+
+#include <algorithm>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "song.h"
+#include "song_schema.h"
+#include "csv_tokenizer.h"
+#include "split_mix64.h"
+
+// Header of the decade CSVs, preceded by a UTF-8 byte order mark
+inline std::string syntheticCsvHeader()
+{
+    return "\xEF\xBB\xBFNumber,title,artist,top genre," + featureNameList(",") + "\r\n";
+}
+
+class SyntheticCatalog
+{
+public:
+    static const int FEATURES = SONG_FEATURE_COUNT;
+
+    SyntheticCatalog(const std::vector<Song> &sample, uint64_t seed)
+        : seed_(seed)
+    {
+    /**
+     * @brief Fits the generator to a sample catalog
+     *
+     * @param sample - songs as read by readFile; must not be empty
+     * @param seed - selects the catalog; equal seeds give identical output
+     */
+        for (const Song &song : sample)
+        {
+            for (int k = 0; k < FEATURES; ++k)
+            {
+                sorted_[k].push_back(song.*SONG_FEATURES[k].member);
+            }
+            titles_.push_back(song.title);
+            artists_.push_back(song.artist);
+            genres_.push_back(song.genre);
+        }
+        for (int k = 0; k < FEATURES; ++k)
+        {
+            std::sort(sorted_[k].begin(), sorted_[k].end());
+        }
+    }
+
+    void row(uint64_t i, Song &song) const
+    {
+    /**
+     * @brief Generates row i of the catalog
+     *
+     * @param i - row number, from 0
+     * @param song - receives the row; dj_score is set to 0
+     */
+        SplitMix64 rng{seed_ ^ (i * 0xD1B54A32D192ED03ULL)};
+        rng.next();
+
+        // Titles get the row number so every title in the catalog is distinct
+        song.title = titles_[rng.below(titles_.size())];
+        song.title += " #" + std::to_string(i + 1);
+        song.artist = artists_[rng.below(artists_.size())];
+        song.genre = genres_[rng.below(genres_.size())];
+
+        for (int k = 0; k < FEATURES; ++k)
+        {
+            song.*SONG_FEATURES[k].member = draw(k, rng.uniform());
+        }
+        song.dj_score = 0;
+    }
+
+    void writeCsv(std::ostream &out, uint64_t firstRow, uint64_t rows, bool header = true) const
+    {
+    /**
+     * @brief Writes rows [firstRow, firstRow + rows) in the decade CSV format
+     *
+     * @param out - destination stream
+     * @param firstRow - first row number to generate
+     * @param rows - number of rows
+     * @param header - write the BOM and header line first
+     */
+        std::string buffer;
+        buffer.reserve(BUFFER_BYTES + 1024);
+        if (header)
+        {
+            buffer += syntheticCsvHeader();
+        }
+        Song song;
+        for (uint64_t i = firstRow; i < firstRow + rows; ++i)
+        {
+            row(i, song);
+            appendInt(buffer, static_cast<long long>(i + 1));
+            buffer += ',';
+            appendCsvField(buffer, song.title);
+            buffer += ',';
+            appendCsvField(buffer, song.artist);
+            buffer += ',';
+            appendCsvField(buffer, song.genre);
+            for (int k = 0; k < FEATURES; ++k)
+            {
+                buffer += ',';
+                appendInt(buffer, song.*SONG_FEATURES[k].member);
+            }
+            buffer += "\r\n";
+            if (buffer.size() >= BUFFER_BYTES)
+            {
+                out.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+                buffer.clear();
+            }
+        }
+        out.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+    }
+
+private:
+    static const size_t BUFFER_BYTES = 1 << 20;
+
+    int draw(int k, double u) const
+    {
+    /**
+     * @brief Inverse CDF of feature k's sample, linearly interpolated and rounded
+     */
+        const std::vector<int> &values = sorted_[k];
+        double pos = u * (values.size() - 1);
+        size_t lo = static_cast<size_t>(pos);
+        size_t hi = std::min(lo + 1, values.size() - 1);
+        double value = values[lo] + (pos - lo) * (values[hi] - values[lo]);
+        return static_cast<int>(value < 0 ? value - 0.5 : value + 0.5);
+    }
+
+    static void appendInt(std::string &buffer, long long value)
+    {
+        char digits[24];
+        std::to_chars_result result = std::to_chars(digits, digits + sizeof(digits), value);
+        buffer.append(digits, result.ptr);
+    }
+
+    uint64_t seed_;
+    std::vector<int> sorted_[FEATURES];
+    std::vector<std::string> titles_;
+    std::vector<std::string> artists_;
+    std::vector<std::string> genres_;
+};
+
+#endif // PLAYLIST_SYNTHETIC_CATALOG_H
@@ -0,0 +1,230 @@
+/**
+ * @file title_index.h
+ * @brief Hashed title index used to find setpoint songs.
+ * Titles are normalized (ASCII case-folded, leading/trailing whitespace trimmed, inner runs of
+ * whitespace collapsed to one space) and stored once per distinct title in an open-addressing
+ * table with linear probing. Each distinct title owns a contiguous run of row indices, so a
+ * lookup is one hash plus a short probe and returns every song sharing that title. An optional
+ * artist narrows the candidates using a per-row hash of the normalized artist, confirmed by
+ * comparing the artist itself.
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef PLAYLIST_TITLE_INDEX_H
+#define PLAYLIST_TITLE_INDEX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "song.h"
+#include "song_table.h"
+#include "string_arena.h"
+
+inline std::string normalizeKey(std::string_view text)
+{
+/**
+ * @brief Normalizes a title or artist for lookup: ASCII lowercase, trimmed, single spaces
+ *
+ * @param text - raw title or artist
+ */
+    std::string key;
+    key.reserve(text.size());
+    bool pendingSpace = false;
+    for (char c : text)
+    {
+        if (c == ' ' || c == '\t' || c == '\r' || c == '\n')
+        {
+            pendingSpace = !key.empty();
+            continue;
+        }
+        if (pendingSpace)
+        {
+            key.push_back(' ');
+            pendingSpace = false;
+        }
+        key.push_back(c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c);
+    }
+    return key;
+}
+
+/**
+ * @brief Row indices that share one title, in catalog order
+ *
+ */
+struct TitleMatches
+{
+    const uint32_t *first = nullptr;
+    const uint32_t *last = nullptr;
+
+    const uint32_t *begin() const { return first; }
+    const uint32_t *end() const { return last; }
+    size_t size() const { return static_cast<size_t>(last - first); }
+    bool empty() const { return first == last; }
+};
+
+/**
+ * @brief Open-addressing hash index from normalized title to row indices
+ *
+ */
+class TitleIndex
+{
+public:
+    template <typename TitleAt, typename ArtistAt>
+    void build(size_t rows, TitleAt titleAt, ArtistAt artistAt)
+    {
+    /**
+     * @brief (Re)builds the index over rows 0..rows-1
+     *
+     * @param rows - number of rows in the catalog
+     * @param titleAt - titleAt(i) returns the title of row i
+     * @param artistAt - artistAt(i) returns the artist of row i
+     */
+        keys_.clear();
+        keyHashes_.clear();
+
+        // Table sized for a load factor of at most 1/2, assuming every title is distinct
+        size_t capacity = 16;
+        while (capacity < rows * 2)
+        {
+            capacity *= 2;
+        }
+        mask_ = capacity - 1;
+        slots_.assign(capacity, EMPTY);
+
+        // Pass 1: assign a key id per distinct normalized title
+        std::vector<uint32_t> rowKey(rows);
+        for (size_t i = 0; i < rows; ++i)
+        {
+            std::string key = normalizeKey(titleAt(i));
+            uint64_t hash = hashKey(key);
+            size_t slot = probe(key, hash);
+            if (slots_[slot] == EMPTY)
+            {
+                slots_[slot] = static_cast<uint32_t>(keys_.size());
+                keys_.push_back(std::move(key));
+                keyHashes_.push_back(hash);
+            }
+            rowKey[i] = slots_[slot];
+        }
+
+        // Pass 2: counting sort rows by key id so each title's rows are contiguous
+        offsets_.assign(keys_.size() + 1, 0);
+        for (size_t i = 0; i < rows; ++i)
+        {
+            ++offsets_[rowKey[i] + 1];
+        }
+        for (size_t k = 0; k < keys_.size(); ++k)
+        {
+            offsets_[k + 1] += offsets_[k];
+        }
+        rows_.resize(rows);
+        artistHashes_.resize(rows);
+        std::vector<uint32_t> next(offsets_.begin(), offsets_.end() - 1);
+        for (size_t i = 0; i < rows; ++i)
+        {
+            uint32_t pos = next[rowKey[i]]++;
+            rows_[pos] = static_cast<uint32_t>(i);
+            artistHashes_[pos] = hashKey(normalizeKey(artistAt(i)));
+        }
+    }
+
+    void build(const std::vector<Song> &songData)
+    {
+        build(songData.size(),
+              [&songData](size_t i) -> const std::string & { return songData[i].title; },
+              [&songData](size_t i) -> const std::string & { return songData[i].artist; });
+    }
+
+    void build(const SongTable &table)
+    {
+        build(table.size(),
+              [&table](size_t i) { return table.text.title(i); },
+              [&table](size_t i) { return table.text.artist(i); });
+    }
+
+    TitleMatches find(std::string_view title) const
+    {
+    /**
+     * @brief Every row whose normalized title equals the normalized query
+     *
+     * @param title - title as typed by the user
+     */
+        if (slots_.empty())
+        {
+            return TitleMatches();
+        }
+        std::string key = normalizeKey(title);
+        size_t slot = probe(key, hashKey(key));
+        if (slots_[slot] == EMPTY)
+        {
+            return TitleMatches();
+        }
+        uint32_t k = slots_[slot];
+        return TitleMatches{rows_.data() + offsets_[k], rows_.data() + offsets_[k + 1]};
+    }
+
+    template <typename ArtistAt>
+    std::vector<uint32_t> find(std::string_view title, std::string_view artist, ArtistAt artistAt) const
+    {
+    /**
+     * @brief Rows matching both title and artist (each normalized). The stored artist hash
+     * only screens candidates; a row matches when its normalized artist equals the query's.
+     *
+     * @param title - title as typed by the user
+     * @param artist - artist as typed by the user
+     * @param artistAt - artistAt(i) returns the artist of row i, as given to build
+     */
+        std::vector<uint32_t> matches;
+        TitleMatches candidates = find(title);
+        if (candidates.empty())
+        {
+            return matches;
+        }
+        const std::string artistKey = normalizeKey(artist);
+        const uint64_t artistHash = hashKey(artistKey);
+        size_t base = static_cast<size_t>(candidates.begin() - rows_.data());
+        for (size_t i = 0; i < candidates.size(); ++i)
+        {
+            if (artistHashes_[base + i] == artistHash && normalizeKey(artistAt(candidates.begin()[i])) == artistKey)
+            {
+                matches.push_back(candidates.begin()[i]);
+            }
+        }
+        return matches;
+    }
+
+    size_t distinctTitles() const { return keys_.size(); }
+
+private:
+    static constexpr uint32_t EMPTY = UINT32_MAX;
+
+    size_t probe(const std::string &key, uint64_t hash) const
+    {
+    /**
+     * @brief Linear probe for key: returns its slot, or the empty slot where it belongs
+     */
+        size_t slot = static_cast<size_t>(hash) & mask_;
+        while (slots_[slot] != EMPTY
+               && (keyHashes_[slots_[slot]] != hash || keys_[slots_[slot]] != key))
+        {
+            slot = (slot + 1) & mask_;
+        }
+        return slot;
+    }
+
+    std::vector<uint32_t> slots_;         // key id per slot, EMPTY if unused
+    size_t mask_ = 0;
+    std::vector<std::string> keys_;       // normalized title per key id
+    std::vector<uint64_t> keyHashes_;     // hash per key id, checked before comparing strings
+    std::vector<uint32_t> offsets_;       // rows_[offsets_[k]..offsets_[k+1]) share key k
+    std::vector<uint32_t> rows_;          // row indices grouped by key
+    std::vector<uint64_t> artistHashes_;  // normalized artist hash, parallel to rows_
+};
+
+#endif // PLAYLIST_TITLE_INDEX_H
@@ -0,0 +1,157 @@
+/**
+ * @file top_k.h
+ * @brief Top-K playlist selection without sorting the whole catalog.
+ * A bounded max-heap of row indices keeps the K best rows seen so far, so selecting K of N
+ * rows costs O(N log K) comparisons and only the K winners are sorted. Rows are referred to
+ * by index and compared in place; no Song is ever copied.
+ *
+ * @copyright Copyright (c) 2023
+ *
+ */
+
+#ifndef PLAYLIST_TOP_K_H
+#define PLAYLIST_TOP_K_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "song.h"
+#include "dj_score.h"
+#include "song_table.h"
+#include "run_stats.h"
+
+template <typename Less>
+void selectTopK(size_t rows, size_t k, Less less, std::vector<uint32_t> &topK)
+{
+/**
+ * @brief Selects the k smallest rows under less and returns them sorted
+ *
+ * @param rows - number of rows, addressed as 0..rows-1
+ * @param k - number of rows to keep (clamped to rows)
+ * @param less - strict ordering on row indices, e.g. compareSong on the rows
+ * @param topK - receives at most k row indices in ascending order
+ */
+    topK.clear();
+    k = std::min(k, rows);
+    if (k == 0)
+    {
+        return;
+    }
+    topK.reserve(k);
+
+    // The heap's front is the worst row kept so far
+    for (uint32_t row = 0; row < rows; ++row)
+    {
+        if (topK.size() < k)
+        {
+            topK.push_back(row);
+            std::push_heap(topK.begin(), topK.end(), less);
+        }
+        else if (less(row, topK.front()))
+        {
+            std::pop_heap(topK.begin(), topK.end(), less);
+            topK.back() = row;
+            std::push_heap(topK.begin(), topK.end(), less);
+        }
+    }
+    std::sort_heap(topK.begin(), topK.end(), less);
+}
+
+inline void topKSongs(const std::vector<Song> &songData, size_t k, std::vector<uint32_t> &topK)
+{
+/**
+ * @brief Indices of the k best scored songs, in compareSong order
+ *
+ * @param songData - vector of all song data with dj_score filled in
+ * @param k - playlist length
+ * @param topK - receives indices into songData
+ */
+    selectTopK(songData.size(), k, [&songData](uint32_t a, uint32_t b) {
+        return compareSong(songData[a], songData[b]);
+    }, topK);
+}
+
+inline void topKRows(const SongTable &table, const std::vector<double> &dist2, size_t k,
+                     std::vector<uint32_t> &topK, uint64_t *comparisons = nullptr)
+{
+/**
+ * @brief Indices of the k rows with the smallest squared distance, ties broken by artist
+ * (the same order as sortRowsBySquaredDistance)
+ *
+ * @param table - catalog the distances belong to
+ * @param dist2 - squared distance per row
+ * @param k - playlist length
+ * @param topK - receives row indices
+ * @param comparisons - if not null, every comparison is added to it
+ */
+    const SongText &text = table.text;
+    auto closer = [&](uint32_t a, uint32_t b) {
+        if (dist2[a] != dist2[b])
+        {
+            return dist2[a] < dist2[b];
+        }
+        return text.artistLess(a, b);
+    };
+    if (comparisons != nullptr)
+    {
+        selectTopK(table.size(), k, CountingLess<decltype(closer)>{closer, comparisons}, topK);
+    }
+    else
+    {
+        selectTopK(table.size(), k, closer, topK);
+    }
+}
+
+inline void topKRowsOf(const SongTable &table, const std::vector<double> &dist2, const std::vector<uint32_t> &rows,
+                       size_t k, std::vector<uint32_t> &topK, uint64_t *comparisons = nullptr)
+{
+/**
+ * @brief Like topKRows, but only among the given rows, e.g. the ones a filter kept
+ *
+ * @param table - catalog the distances belong to
+ * @param dist2 - squared distance per row; only entries of rows are read
+ * @param rows - candidate rows
+ * @param k - playlist length (0 = every candidate)
+ * @param topK - receives row indices
+ * @param comparisons - if not null, every comparison is added to it
+ */
+    const SongText &text = table.text;
+    auto closer = [&](uint32_t a, uint32_t b) {
+        if (dist2[a] != dist2[b])
+        {
+            return dist2[a] < dist2[b];
+        }
+        return text.artistLess(a, b);
+    };
+    auto closerRow = [&](uint32_t a, uint32_t b) { return closer(rows[a], rows[b]); };
+    if (k == 0 || k >= rows.size())
+    {
+        topK = rows;
+        if (comparisons != nullptr)
+        {
+            std::sort(topK.begin(), topK.end(), CountingLess<decltype(closer)>{closer, comparisons});
+        }
+        else
+        {
+            std::sort(topK.begin(), topK.end(), closer);
+        }
+        return;
+    }
+    if (comparisons != nullptr)
+    {
+        selectTopK(rows.size(), k, CountingLess<decltype(closerRow)>{closerRow, comparisons}, topK);
+    }
+    else
+    {
+        selectTopK(rows.size(), k, closerRow, topK);
+    }
+    for (uint32_t &index : topK)
+    {
+        index = rows[index];
+    }
+}
+
+#endif // PLAYLIST_TOP_K_H